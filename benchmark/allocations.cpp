@@ -0,0 +1,39 @@
+//
+// allocations.cpp
+//
+
+#include "pch.h"
+
+#include "allocations.h"
+
+// The replaced allocation functions are defined in their own translation
+// unit: inlined next to the containers which use them, the compiler pairs
+// the allocations of operator new with the std::free of operator delete and
+// warns about a mismatch which is not there. Every form (single and array,
+// sized and unsized) is replaced, so that each allocation and its release
+// go through the same pair of functions.
+
+namespace {
+std::atomic<std::size_t> allocations(0);
+
+void* allocate(std::size_t size)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	if (void* p = std::malloc(size == 0 ? 1 : size))
+		return p;
+	throw std::bad_alloc();
+}
+}
+
+std::size_t allocation_count() noexcept
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+void* operator new(std::size_t size) { return allocate(size); }
+void* operator new[](std::size_t size) { return allocate(size); }
+
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
@@ -0,0 +1,11 @@
+//
+// allocations.h
+//
+
+#pragma once
+
+// Every allocation made by the process through operator new (and new[]) is
+// counted, so that each benchmark can report its allocations per operation
+// next to its throughput. The replacement allocation functions live in
+// allocations.cpp, out of sight of the code they are called from.
+std::size_t allocation_count() noexcept;
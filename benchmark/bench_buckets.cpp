@@ -0,0 +1,428 @@
+#include "pch.h"
+
+#include "allocations.h"
+
+#include "../include/buckets.h"
+#include "../include/buckets_supp.h"
+#include "../include/frozen_buckets.h"
+#include "../include/test/workload.h"
+
+using namespace masutils;
+using namespace mastest;
+
+namespace {
+
+const int bucket_width = 10;
+
+// Reports the allocations made since it was created, per iteration.
+class allocation_counter
+{
+public:
+	allocation_counter() : start_(allocation_count()) {}
+
+	void report(benchmark::State& state, std::size_t excluded = 0) const
+	{
+		const std::size_t made = allocation_count() - start_ - excluded;
+		state.counters["allocs/op"] = benchmark::Counter(static_cast<double>(made), benchmark::Counter::kAvgIterations);
+	}
+
+private:
+	std::size_t start_;
+};
+
+// n back to back buckets of bucket_width, built through a cursor
+template <class Bucket>
+void build(Bucket& bucket, int n)
+{
+	typename Bucket::cursor cursor(bucket);
+	for (int i = 0; i < n; ++i)
+		cursor.spread(i * bucket_width, (i + 1) * bucket_width, i % 16);
+}
+
+// The edit patterns. The ordered ones go through a cursor, which is how
+// ordered edits are meant to be made; the random one uses the plain calls.
+// All of them stay within the prebuilt range and come in passes (an ordered
+// pattern wraps around, the random one makes n edits). After every pass the
+// collection is built again (untimed), so that every pass edits the prebuilt
+// buckets like the first one did: the collection does not keep growing with
+// the number of iterations (random splits alone would take it to about ten
+// times n buckets), and the ordered passes do not land on the boundaries
+// the previous pass left behind.
+
+// back to back ranges, half a bucket off the prebuilt ones
+struct sequential_edits
+{
+	static const bool ordered = true;
+
+	explicit sequential_edits(int n) : end_(n * bucket_width), next_(bucket_width / 2) {}
+
+	bool operator()(std::mt19937&, int& low, int& high)
+	{
+		const bool wrapped = next_ + bucket_width > end_;
+		if (wrapped)
+			next_ = bucket_width / 2;
+		low = next_;
+		high = next_ + bucket_width;
+		next_ = high;
+		return wrapped;
+	}
+
+	int end_;
+	int next_;
+};
+
+// overlapping ranges with increasing starts, like events logged in order
+struct monotonic_edits
+{
+	static const bool ordered = true;
+
+	explicit monotonic_edits(int n) : end_(n * bucket_width), next_(0) {}
+
+	bool operator()(std::mt19937& rng, int& low, int& high)
+	{
+		const int length = 1 + static_cast<int>(rng() % (3 * bucket_width));
+		const bool wrapped = next_ + length > end_;
+		if (wrapped)
+			next_ = 0;
+		low = next_;
+		high = next_ + length;
+		next_ += 1 + static_cast<int>(rng() % bucket_width);
+		return wrapped;
+	}
+
+	int end_;
+	int next_;
+};
+
+struct random_edits
+{
+	static const bool ordered = false;
+
+	explicit random_edits(int n) : end_(n * bucket_width), pass_(n), made_(0) {}
+
+	bool operator()(std::mt19937& rng, int& low, int& high)
+	{
+		const bool wrapped = made_ == pass_;
+		if (wrapped)
+			made_ = 0;
+		made_++;
+		const int length = 1 + static_cast<int>(rng() % (3 * bucket_width));
+		low = static_cast<int>(rng() % static_cast<unsigned>(end_ - length));
+		high = low + length;
+		return wrapped;
+	}
+
+	int end_;
+	int pass_;
+	int made_;
+};
+
+struct spread_edit
+{
+	template <class Target>
+	static int apply(Target& target, int low, int high, int value) { return target.spread(low, high, value); }
+};
+
+struct cover_edit
+{
+	template <class Target>
+	static int apply(Target& target, int low, int high, int value) { return target.cover(low, high, value); }
+};
+
+// a fresh collection for the next pass, not timed or counted
+template <class Bucket>
+void rebuild(Bucket& bucket, int n, benchmark::State& state, std::size_t& excluded)
+{
+	state.PauseTiming();
+	const std::size_t before = allocation_count();
+	bucket = Bucket();
+	build(bucket, n);
+	excluded += allocation_count() - before;
+	state.ResumeTiming();
+}
+
+template <class Bucket, class Edits, class Edit>
+void edit(Bucket& bucket, int n, Edits& edits, std::mt19937& rng, benchmark::State& state, std::size_t& excluded, std::true_type)
+{
+	typename Bucket::cursor cursor(bucket);
+	int low, high, value = 0;
+	for (auto _ : state)
+	{
+		if (edits(rng, low, high))
+		{
+			rebuild(bucket, n, state, excluded);
+			cursor.reset();
+		}
+		benchmark::DoNotOptimize(Edit::apply(cursor, low, high, ++value & 15));
+	}
+}
+
+template <class Bucket, class Edits, class Edit>
+void edit(Bucket& bucket, int n, Edits& edits, std::mt19937& rng, benchmark::State& state, std::size_t& excluded, std::false_type)
+{
+	int low, high, value = 0;
+	for (auto _ : state)
+	{
+		if (edits(rng, low, high))
+			rebuild(bucket, n, state, excluded);
+		benchmark::DoNotOptimize(Edit::apply(bucket, low, high, ++value & 15));
+	}
+}
+
+// spread or cover into a collection of state.range(0) buckets
+template <class ContainerTraits, class Edits, class Edit>
+void BM_Edit(benchmark::State& state)
+{
+	typedef buckets<int, int, compare_traits<int>, ContainerTraits> Bucket;
+
+	const int n = static_cast<int>(state.range(0));
+	Bucket bucket;
+	build(bucket, n);
+
+	std::mt19937 rng(42);
+	Edits edits(n);
+
+	allocation_counter counter;
+	std::size_t excluded = 0;
+	edit<Bucket, Edits, Edit>(bucket, n, edits, rng, state, excluded, std::integral_constant<bool, Edits::ordered>());
+	counter.report(state, excluded);
+
+	state.SetItemsProcessed(state.iterations());
+	state.counters["buckets"] = static_cast<double>(bucket.size());
+}
+
+void BM_PointLookup(benchmark::State& state)
+{
+	const int n = static_cast<int>(state.range(0));
+	buckets<int, int> bucket;
+	build(bucket, n);
+
+	std::mt19937 rng(42);
+	allocation_counter counter;
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bucket.find(static_cast<int>(rng() % static_cast<unsigned>(n * bucket_width))));
+	counter.report(state);
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+// 1000 random points per iteration, answered in one pass
+void BM_BatchLookup(benchmark::State& state)
+{
+	const int n = static_cast<int>(state.range(0));
+	buckets<int, int> bucket;
+	build(bucket, n);
+
+	std::mt19937 rng(42);
+	std::vector<int> points(1000);
+	std::vector<buckets<int, int>::const_iterator> found;
+
+	allocation_counter counter;
+	for (auto _ : state)
+	{
+		for (auto& point : points)
+			point = static_cast<int>(rng() % static_cast<unsigned>(n * bucket_width));
+		benchmark::DoNotOptimize(bucket.find_batch(points, found));
+	}
+	counter.report(state);
+
+	state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(points.size()));
+}
+
+// The batched lookup target: 10M random points against 1M buckets, looked
+// up in one find_batch against one at a time (with the linear find of the
+// list, and with the binary search of a frozen copy). All three report
+// points per second over the same points, so they compare directly; the
+// single lookups take one point per iteration, since ten million finds over
+// the list would take hours.
+const int lookup_buckets = 1000000;
+const std::size_t lookup_points = 10000000;
+
+const std::vector<int>& lookup_target_points()
+{
+	static const std::vector<int> points = [] {
+		std::mt19937 rng(42);
+		std::vector<int> result(lookup_points);
+		for (auto& point : result)
+			point = static_cast<int>(rng() % static_cast<unsigned>(lookup_buckets * bucket_width));
+		return result;
+	}();
+	return points;
+}
+
+void BM_LookupTargetBatch(benchmark::State& state)
+{
+	buckets<int, int> bucket;
+	build(bucket, lookup_buckets);
+	const std::vector<int>& points = lookup_target_points();
+	std::vector<buckets<int, int>::const_iterator> found;
+
+	for (auto _ : state)
+		benchmark::DoNotOptimize(bucket.find_batch(points, found));
+
+	state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(points.size()));
+}
+
+void BM_LookupTargetSingle(benchmark::State& state)
+{
+	buckets<int, int> bucket;
+	build(bucket, lookup_buckets);
+	const std::vector<int>& points = lookup_target_points();
+
+	std::size_t next = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(bucket.find(points[next]));
+		next = next + 1 == points.size() ? 0 : next + 1;
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+void BM_LookupTargetFrozenSingle(benchmark::State& state)
+{
+	buckets<int, int> bucket;
+	build(bucket, lookup_buckets);
+	const auto frozen = bucket.freeze();
+	const std::vector<int>& points = lookup_target_points();
+
+	std::size_t next = 0;
+	for (auto _ : state)
+	{
+		benchmark::DoNotOptimize(frozen.find(points[next]));
+		next = next + 1 == points.size() ? 0 : next + 1;
+	}
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+// the buckets overlapping a random window of 10 buckets
+void BM_RangeScan(benchmark::State& state)
+{
+	const int n = static_cast<int>(state.range(0));
+	buckets<int, int> bucket;
+	build(bucket, n);
+
+	std::mt19937 rng(42);
+	const int window = 10 * bucket_width;
+
+	allocation_counter counter;
+	for (auto _ : state)
+	{
+		const int low = static_cast<int>(rng() % static_cast<unsigned>(n * bucket_width - window));
+		int values = 0;
+		for (auto p = bucket.beginRange<false>(low, low + window), end = bucket.endRange<false>(low, low + window); p != end; ++p)
+			values += static_cast<int>(p->third.size());
+		benchmark::DoNotOptimize(values);
+	}
+	counter.report(state);
+
+	state.SetItemsProcessed(state.iterations());
+}
+
+// spreads one collection of state.range(0) buckets into another, shifted by
+// half a bucket so that every bucket is split
+void BM_Merge(benchmark::State& state)
+{
+	const int n = static_cast<int>(state.range(0));
+	buckets<int, int> source;
+	{
+		buckets<int, int>::cursor cursor(source);
+		for (int i = 0; i < n; ++i)
+			cursor.spread(i * bucket_width + bucket_width / 2, (i + 1) * bucket_width + bucket_width / 2, i % 16);
+	}
+
+	allocation_counter counter;
+	std::size_t excluded = 0;
+	std::unique_ptr<buckets<int, int>> target;
+	for (auto _ : state)
+	{
+		// a fresh target for every merge, not timed or counted
+		state.PauseTiming();
+		const std::size_t before = allocation_count();
+		target.reset(new buckets<int, int>());
+		build(*target, n);
+		excluded += allocation_count() - before;
+		state.ResumeTiming();
+
+		benchmark::DoNotOptimize(target->spread(source));
+	}
+	counter.report(state, excluded);
+
+	state.SetItemsProcessed(state.iterations() * n);
+}
+
+// builds a schedule from a generated workload; the edits come in the order
+// people enter them, not sorted
+template <class Workload>
+void run_workload(benchmark::State& state, const Workload& edits)
+{
+	allocation_counter counter;
+	std::size_t size = 0;
+	for (auto _ : state)
+	{
+		buckets<long long, int> bucket;
+		apply_workload(bucket, edits);
+		size = bucket.size();
+	}
+	counter.report(state);
+
+	state.SetItemsProcessed(state.iterations() * static_cast<std::int64_t>(edits.size()));
+	state.counters["buckets"] = static_cast<double>(size);
+}
+
+// state.range(0) days of staff rosters
+void BM_RosterWorkload(benchmark::State& state)
+{
+	roster_options options;
+	options.days = static_cast<int>(state.range(0));
+	run_workload(state, make_roster_workload<long long>(options));
+}
+
+// state.range(0) weeks of calendars
+void BM_CalendarWorkload(benchmark::State& state)
+{
+	calendar_options options;
+	options.weeks = static_cast<int>(state.range(0));
+	run_workload(state, make_calendar_workload<long long>(options));
+}
+
+typedef bucket_value_traits<int> vector_values;
+typedef most_recent_bucket_value_traits<int> most_recent_values;
+typedef bucket_value_add_traits<int> added_values;
+typedef unique_bucket_value_traits<int> unique_values;
+
+} // namespace
+
+#define BUCKET_SIZES RangeMultiplier(10)->Range(1000, 1000000)
+
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, sequential_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, monotonic_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, random_edits, spread_edit)->BUCKET_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, sequential_edits, cover_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, monotonic_edits, cover_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, vector_values, random_edits, cover_edit)->BUCKET_SIZES;
+
+BENCHMARK_TEMPLATE(BM_Edit, most_recent_values, monotonic_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, most_recent_values, random_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, added_values, monotonic_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, added_values, random_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, unique_values, monotonic_edits, spread_edit)->BUCKET_SIZES;
+BENCHMARK_TEMPLATE(BM_Edit, unique_values, random_edits, spread_edit)->BUCKET_SIZES;
+
+BENCHMARK(BM_PointLookup)->BUCKET_SIZES;
+BENCHMARK(BM_BatchLookup)->BUCKET_SIZES;
+BENCHMARK(BM_LookupTargetBatch)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LookupTargetSingle)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_LookupTargetFrozenSingle);
+BENCHMARK(BM_RangeScan)->BUCKET_SIZES;
+
+// merging spreads every bucket of the source from the front of the target,
+// so it is quadratic and stops at 1e4 buckets
+BENCHMARK(BM_Merge)->RangeMultiplier(10)->Range(1000, 10000)->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_RosterWorkload)->Arg(7)->Arg(30)->Arg(365)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_CalendarWorkload)->Arg(1)->Arg(4)->Arg(13)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -257,6 +257,18 @@ void example12() {
 	std::cout << "bucket is:\n" << bucket_wrapper<glossary<char, const char*, caseInsensitiveLess<std::basic_string<char>>>>(bucket) << std::endl;
 }
 
+void example13() {
+	interned_glossary<char, caseInsensitiveLess<interned_string<char>>> bucket; // unconstrained bucket
+
+	std::cout << "============ example13 ============" << std::endl;
+
+	for (auto it = words.begin(); it != words.end(); ++it) {
+		bucket.add(*it);
+	}
+
+	std::cout << "bucket is:\n" << bucket_wrapper<interned_glossary<char, caseInsensitiveLess<interned_string<char>>>>(bucket) << std::endl;
+}
+
 int main()
 {
 	std::cout << "start timestamp: " << time_stamp() << std::endl << std::endl;
@@ -273,6 +285,7 @@ int main()
 	example10();
 	example11();
 	example12();
+	example13();
 
 	std::cout << "\nend timestamp: " << time_stamp() << std::endl;
 
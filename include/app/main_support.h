@@ -33,6 +33,10 @@
 #include <chrono>
 #endif // !CHRONO_H_
 
+#ifndef MASUTILS_STRING_POOL_H_
+#include "../string_pool.h"
+#endif // !MASUTILS_STRING_POOL_H_
+
 namespace masxtra {
 
 inline std::tm localtime_xp(std::time_t timer)
@@ -116,6 +120,11 @@ struct glossary : public masutils::buckets<
 	}
 };
 
+// A glossary whose buckets hold handles into the shared string pool instead of
+// their own copies of every word; splitting a bucket copies pointers only.
+template <typename T, typename P = std::less<masutils::interned_string<T>>>
+using interned_glossary = glossary<T, masutils::interned_string<T>, P>;
+
 } // namespace masxtra
 
 namespace masutils {
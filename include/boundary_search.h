@@ -0,0 +1,195 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// boundary_search.h - Search of a contiguous, sorted array of bucket boundaries
+
+#ifndef MASUTILS_BOUNDARY_SEARCH_H_
+#define MASUTILS_BOUNDARY_SEARCH_H_
+
+#ifndef ALGORITHM_H_
+#include <algorithm>
+#endif // ALGORITHM_H_
+
+#ifndef CSTDDEF_H_
+#include <cstddef>
+#endif // CSTDDEF_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif // __AVX2__
+
+#include "compare_traits.h"
+
+namespace masutils {
+
+// The vectorized search is only used when the ordering of Traits is known to
+// be the plain ascending or descending ordering of an integral type (time_t is
+// an integral type). Any other combination, including custom compare traits,
+// uses the generic search which only relies on Traits::lt.
+template <class Traits, class Index>
+struct is_vectorizable_search : std::integral_constant<bool,
+	std::is_integral<Index>::value &&
+	(std::is_same<Traits, compare_traits<Index>>::value ||
+	 std::is_same<Traits, compare_traits_descending<Index>>::value)> {};
+
+// The searches live in an inline namespace named after the instruction set
+// they are compiled for, so that a program whose translation units are
+// compiled with different settings (one with AVX2 enabled, the others
+// without) gets a separate instantiation for each, instead of the linker
+// keeping one of them for all.
+#if defined(__AVX2__)
+inline namespace search_avx2 {
+#else
+inline namespace search_generic {
+#endif // __AVX2__
+
+// boundary_search<Traits, Index>::upper_bound(data, n, key) returns the number
+// of leading elements of the sorted array data[0..n) which are not after key
+// in the Traits ordering, the same position std::upper_bound would return.
+// lower_bound(data, n, key) returns the number of leading elements which are
+// before key, the same position std::lower_bound would return.
+template <class Traits, class Index, bool Vectorized = is_vectorizable_search<Traits, Index>::value>
+struct boundary_search
+{
+	static constexpr bool vectorized = false;
+
+	static std::size_t upper_bound(const Index* data, std::size_t n, const Index& key)
+	{
+		return static_cast<std::size_t>(
+			std::upper_bound(data, data + n, key, [](const Index& x_, const Index& y_) { return Traits::lt(x_, y_); }) - data);
+	}
+
+	static std::size_t lower_bound(const Index* data, std::size_t n, const Index& key)
+	{
+		return static_cast<std::size_t>(
+			std::lower_bound(data, data + n, key, [](const Index& x_, const Index& y_) { return Traits::lt(x_, y_); }) - data);
+	}
+};
+
+template <class Traits, class Index>
+struct boundary_search<Traits, Index, true>
+{
+	static constexpr bool vectorized = true;
+
+	// the binary search stops once the candidates fit in a few cache lines,
+	// the rest is counted with compares which need no branches
+	static constexpr std::size_t window = 64;
+
+	static std::size_t upper_bound(const Index* data, std::size_t n, const Index& key)
+	{
+		const Index* base = data;
+		while (n > window)
+		{
+			const std::size_t half = n / 2;
+			base = Traits::lt(key, base[half]) ? base : base + half;
+			n -= half;
+		}
+		return static_cast<std::size_t>(base - data) + count_not_after(base, n, key);
+	}
+
+	static std::size_t lower_bound(const Index* data, std::size_t n, const Index& key)
+	{
+		const Index* base = data;
+		while (n > window)
+		{
+			const std::size_t half = n / 2;
+			base = Traits::lt(base[half - 1], key) ? base + half : base;
+			n -= half;
+		}
+		return static_cast<std::size_t>(base - data) + (n - count_not_before(base, n, key));
+	}
+
+private:
+	static constexpr bool descending = std::is_same<Traits, compare_traits_descending<Index>>::value;
+
+	static unsigned popcount(unsigned mask) noexcept
+	{
+		unsigned count = 0;
+		for (; mask; mask &= mask - 1)
+			count++;
+		return count;
+	}
+
+	// count of elements which are not after key; written as a plain loop
+	// which the compiler is able to vectorize when no intrinsics are used
+	static std::size_t count_scalar(const Index* data, std::size_t n, const Index& key)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < n; ++i)
+			count += descending ? (key <= data[i]) : (data[i] <= key);
+		return count;
+	}
+
+	// elements which are not before key are the elements which key is not
+	// after, so this is count_not_after with the comparison mirrored
+	static std::size_t count_not_before(const Index* data, std::size_t n, const Index& key)
+	{
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < n; ++i)
+			count += descending ? (data[i] <= key) : (key <= data[i]);
+		return count;
+	}
+
+	static std::size_t count_not_after(const Index* data, std::size_t n, const Index& key)
+	{
+#if defined(__AVX2__)
+		if (std::is_signed<Index>::value && (sizeof(Index) == 4 || sizeof(Index) == 8))
+		{
+			constexpr std::size_t lanes = 32 / sizeof(Index);
+			const __m256i k = (sizeof(Index) == 4)
+				? _mm256_set1_epi32(static_cast<int>(key))
+				: _mm256_set1_epi64x(static_cast<long long>(key));
+
+			std::size_t after = 0, i = 0;
+			for (; i + lanes <= n; i += lanes)
+			{
+				const __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				// ascending: after key when data > key; descending: when key > data
+				const __m256i a = descending ? k : d;
+				const __m256i b = descending ? d : k;
+				const __m256i gt = (sizeof(Index) == 4) ? _mm256_cmpgt_epi32(a, b) : _mm256_cmpgt_epi64(a, b);
+				const unsigned mask = (sizeof(Index) == 4)
+					? static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(gt)))
+					: static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(gt)));
+				after += popcount(mask);
+			}
+			return (i - after) + count_scalar(data + i, n - i, key);
+		}
+#endif // __AVX2__
+		return count_scalar(data, n, key);
+	}
+};
+
+// Convenience wrappers which select the search from the Traits and index type.
+template <class Traits, class Index>
+std::size_t search_upper_bound(const Index* data, std::size_t n, const Index& key)
+{
+	return boundary_search<Traits, Index>::upper_bound(data, n, key);
+}
+
+template <class Traits, class Index>
+std::size_t search_lower_bound(const Index* data, std::size_t n, const Index& key)
+{
+	return boundary_search<Traits, Index>::lower_bound(data, n, key);
+}
+
+} // inline namespace search_avx2 / search_generic
+
+} // namespace masutils
+
+#endif // MASUTILS_BOUNDARY_SEARCH_H_
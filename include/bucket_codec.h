@@ -0,0 +1,155 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// bucket_codec.h - Binary encoding of bucket indices and values
+
+#ifndef MASUTILS_BUCKET_CODEC_H_
+#define MASUTILS_BUCKET_CODEC_H_
+
+#ifndef CSTDDEF_H_
+#include <cstddef>
+#endif // CSTDDEF_H_
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // CSTDINT_H_
+
+#ifndef CSTRING_H_
+#include <cstring>
+#endif // CSTRING_H_
+
+#ifndef STRING_H_
+#include <string>
+#endif // STRING_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+namespace masutils {
+
+// bucket_codec<T>::write(out, value) appends the binary form of value to the
+// byte buffer out, and bucket_codec<T>::read(p, end, value) decodes a value
+// from [p, end), advancing p, and returns false when the buffer ends before
+// the value does. The encoding is the in-memory representation, so it is
+// only meant to be read back on the same platform.
+//
+// Trivially copyable types (integers, doubles, time_t, plain structs) and
+// std::basic_string are supported; specialize bucket_codec for other types.
+// Pointers (e.g. the char* of buckets<time_t, char*>) are rejected: their
+// bytes are an address, which means nothing once read back. Such values need
+// a codec of their own which writes what they point to.
+template <class T, class Enable = void>
+struct bucket_codec;
+
+template <class T>
+struct bucket_codec<T, typename std::enable_if<std::is_trivially_copyable<T>::value>::type>
+{
+	static_assert(!std::is_pointer<T>::value && !std::is_member_pointer<T>::value,
+		"bucket_codec cannot store pointers; specialize bucket_codec for this value type");
+
+	static void write(std::string& out, const T& value)
+	{
+		out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	static bool read(const char*& p, const char* end, T& value)
+	{
+		if (static_cast<std::size_t>(end - p) < sizeof(T))
+			return false;
+		std::memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return true;
+	}
+};
+
+// a 32 bit length followed by the characters
+template <class CharT, class CharTraits, class Allocator>
+struct bucket_codec<std::basic_string<CharT, CharTraits, Allocator>>
+{
+	typedef std::basic_string<CharT, CharTraits, Allocator> string_type;
+
+	static void write(std::string& out, const string_type& value)
+	{
+		bucket_codec<std::uint32_t>::write(out, static_cast<std::uint32_t>(value.size()));
+		out.append(reinterpret_cast<const char*>(value.data()), value.size() * sizeof(CharT));
+	}
+
+	static bool read(const char*& p, const char* end, string_type& value)
+	{
+		std::uint32_t size;
+		if (!bucket_codec<std::uint32_t>::read(p, end, size))
+			return false;
+		if (static_cast<std::size_t>(end - p) / sizeof(CharT) < size)
+			return false;
+		value.resize(size);
+		if (size > 0)
+			std::memcpy(&value[0], p, size * sizeof(CharT));
+		p += size * sizeof(CharT);
+		return true;
+	}
+};
+
+template <class T>
+void encode(std::string& out, const T& value)
+{
+	bucket_codec<T>::write(out, value);
+}
+
+template <class T>
+bool decode(const char*& p, const char* end, T& value)
+{
+	return bucket_codec<T>::read(p, end, value);
+}
+
+// Unsigned LEB128: 7 bits per byte, small numbers take a single byte. Used
+// for the (small) distances between sorted boundaries.
+inline void encode_varint(std::string& out, std::uint64_t value)
+{
+	while (value >= 0x80)
+	{
+		out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	out.push_back(static_cast<char>(value));
+}
+
+inline bool decode_varint(const char*& p, const char* end, std::uint64_t& value)
+{
+	value = 0;
+	for (unsigned shift = 0; p != end && shift < 64; shift += 7)
+	{
+		const unsigned char byte = static_cast<unsigned char>(*p++);
+		value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+		if ((byte & 0x80) == 0)
+			return true;
+	}
+	return false;
+}
+
+// FNV-1a, used to detect torn or corrupt records
+inline std::uint32_t codec_checksum(const char* data, std::size_t size) noexcept
+{
+	std::uint32_t hash = 2166136261u;
+	for (std::size_t i = 0; i < size; ++i)
+	{
+		hash ^= static_cast<unsigned char>(data[i]);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+} // namespace masutils
+
+#endif // MASUTILS_BUCKET_CODEC_H_
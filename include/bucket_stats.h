@@ -0,0 +1,151 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// bucket_stats.h - Statistics policies which buckets keep up to date as it changes
+
+#ifndef MASUTILS_BUCKET_STATS_H_
+#define MASUTILS_BUCKET_STATS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef FUNCTIONAL_H_
+#include <functional>
+#endif // FUNCTIONAL_H_
+
+#ifndef MAP_H_
+#include <map>
+#endif // MAP_H_
+
+namespace masutils {
+
+// Number of buckets and the total length they cover. With the extent() of
+// the buckets this also gives the length of the gaps between them. Needs an
+// index type with subtraction (an integral type, time_t, a double, ...).
+// Keeping it costs O(1) per bucket which enters or leaves the collection.
+template <class Index>
+class coverage_stats
+{
+public:
+	typedef Index index_type;
+
+	coverage_stats() : count_(0), covered_() {}
+
+	template <class Triplet>
+	void add(const Triplet& triplet)
+	{
+		count_++;
+		covered_ += length(triplet.first, triplet.second);
+	}
+
+	template <class Triplet>
+	void remove(const Triplet& triplet)
+	{
+		count_--;
+		covered_ -= length(triplet.first, triplet.second);
+	}
+
+	std::size_t bucket_count() const noexcept { return count_; }
+	index_type covered_length() const { return covered_; }
+
+	// length of [low, high) which is not covered by a bucket; pass the
+	// extent() of the buckets for the length of the gaps between them
+	index_type gap_length(const index_type& low, const index_type& high) const
+	{
+		return length(low, high) - covered_;
+	}
+
+private:
+	// works for ascending and descending buckets alike
+	static index_type length(const index_type& low, const index_type& high)
+	{
+		return low < high ? high - low : low - high;
+	}
+
+	std::size_t count_;
+	index_type covered_;
+};
+
+// Number of distinct values held by all of the buckets together. Each value
+// is reference counted by the number of buckets holding it.
+//
+// Unlike coverage_stats this is not cheap: a bucket which changes is removed
+// and added again with all of its values, so every bucket an edit splits,
+// appends to or covers costs O(k log V) (k values in the bucket, V distinct
+// values overall) on every edit, whether the statistic is read or not. It
+// suits buckets holding a few values each; for large containers count the
+// distinct values on demand instead.
+template <class Value, class Compare = std::less<Value>>
+class distinct_value_stats
+{
+public:
+	typedef Value value_type;
+
+	template <class Triplet>
+	void add(const Triplet& triplet)
+	{
+		for (const auto& value : triplet.third)
+			++counts_[value];
+	}
+
+	template <class Triplet>
+	void remove(const Triplet& triplet)
+	{
+		for (const auto& value : triplet.third)
+		{
+			auto found = counts_.find(value);
+			if (found != counts_.end() && --found->second == 0)
+				counts_.erase(found);
+		}
+	}
+
+	std::size_t distinct_values() const noexcept { return counts_.size(); }
+
+	// number of times value is held (a bucket holding it twice counts twice)
+	std::size_t count(const value_type& value) const
+	{
+		auto found = counts_.find(value);
+		return found == counts_.end() ? 0 : found->second;
+	}
+
+private:
+	std::map<value_type, std::size_t, Compare> counts_;
+};
+
+// Keeps several statistics at once, e.g.
+// combined_bucket_stats<coverage_stats<int>, distinct_value_stats<int>>.
+// The accessors of each statistic are available directly.
+template <class... Stats>
+class combined_bucket_stats : public Stats...
+{
+public:
+	template <class Triplet>
+	void add(const Triplet& triplet)
+	{
+		int expand[] = { 0, (Stats::add(triplet), 0)... };
+		(void)expand;
+	}
+
+	template <class Triplet>
+	void remove(const Triplet& triplet)
+	{
+		int expand[] = { 0, (Stats::remove(triplet), 0)... };
+		(void)expand;
+	}
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_BUCKET_STATS_H_
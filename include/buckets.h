@@ -18,16 +18,31 @@
 #ifndef MASUTILS_BUCKETS_H_
 #define MASUTILS_BUCKETS_H_
 
+#include <algorithm>
 #include <functional>
+#include <iterator>
 #include <list>
+#include <numeric>
 #include <stdexcept>
+#include <type_traits>
+#include <vector>
 
 #include "triplet.h"
 #include "compare_traits.h"
+#include "small_vector.h"
 
 namespace masutils
 {
-	template <class E_, class C_ = std::list<E_>>
+	// Read-only, query optimized copy of a buckets (see frozen_buckets.h)
+	template <class Indices, class Values, class Traits, class ContainerTraits>
+	class frozen_buckets;
+
+	// How a frozen_buckets stores the boundaries it searches
+	enum class boundary_encoding { full, relative32 };
+
+	// The default value container keeps the first few values inside the
+	// bucket itself, so small buckets need no allocation for their values.
+	template <class E_, class C_ = small_vector<E_, small_vector_default_capacity<E_>::value>>
 	struct bucket_value_traits
 	{
 		typedef E_ value_type;
@@ -48,21 +63,98 @@ namespace masutils
 		~bucket_value_traits() = default;
 	};
 
+	// The std::list value container bucket_value_traits used before it kept
+	// values inline, for code which relies on list semantics (stable element
+	// addresses, splice, ...).
+	template <class E_>
+	using list_bucket_value_traits = bucket_value_traits<E_, std::list<E_>>;
+
+	// True when ContainerTraits::append only adds values after the ones a
+	// container already holds, so that an append is undone by cutting the
+	// container back to its previous size.
+	template <class ContainerTraits>
+	struct appends_at_end : std::false_type {};
+
+	template <class E_, class C_>
+	struct appends_at_end<bucket_value_traits<E_, C_>> : std::true_type {};
+
+	// Receives a compact description of every change made to a buckets it
+	// is attached to (see buckets::observe), so that a consumer can keep its
+	// own view of the buckets up to date without rescanning them. Only the
+	// events of interest need to be overridden.
+	template <class Index, class Container>
+	class buckets_observer
+	{
+	public:
+		virtual ~buckets_observer() = default;
+
+		// an existing bucket was split in two at index at
+		virtual void split(const Index& at) { (void)at; }
+
+		// values were appended to every bucket in [low, high); a bucket was
+		// created for any part of the range which was not covered before
+		virtual void appended(const Index& low, const Index& high, const Container& values)
+		{
+			(void)low; (void)high; (void)values;
+		}
+
+		// every bucket in [low, high) was replaced by one bucket holding values
+		virtual void covered(const Index& low, const Index& high, const Container& values)
+		{
+			(void)low; (void)high; (void)values;
+		}
+
+		// a batch was started; the events up to committed() or rolled_back()
+		// belong to it
+		virtual void batch_begun() {}
+
+		// the open batch was committed; its events stand
+		virtual void committed() {}
+
+		// the open batch was rolled back; everything reported since
+		// batch_begun() has been undone. Only buckets inside [low, high)
+		// changed (low == high when the batch changed nothing).
+		virtual void rolled_back(const Index& low, const Index& high)
+		{
+			(void)low; (void)high;
+		}
+	};
+
+	// Statistics policy of a buckets. The policy is told about every bucket
+	// which enters the collection (add) and every bucket which leaves it
+	// (remove); a bucket which changes is removed and then added again. This
+	// one keeps no statistics and compiles away (see bucket_stats.h for the
+	// ones which do).
+	struct no_bucket_stats
+	{
+		template <class Triplet>
+		void add(const Triplet&) noexcept {}
+
+		template <class Triplet>
+		void remove(const Triplet&) noexcept {}
+	};
+
 	template <class Indices,
 	          class Values,
 	          class Traits = compare_traits<Indices>,
-	          class ContainerTraits = bucket_value_traits<Values>>
+	          class ContainerTraits = bucket_value_traits<Values>,
+	          class Stats = no_bucket_stats>
 	class buckets
 	{
 	public:
 		typedef buckets<Indices,
 		                Values,
 		                Traits,
-		                ContainerTraits> mytype;
+		                ContainerTraits,
+		                Stats> mytype;
 
 		typedef Indices index_type;
 		typedef Values value_type;
 
+		typedef Traits traits_type;
+		typedef ContainerTraits container_traits;
+		typedef Stats stats_type;
+
 		typedef typename ContainerTraits::value_container value_container;
 		typedef const typename ContainerTraits::value_container const_value_container;
 		typedef triplet<index_type,
@@ -75,6 +167,8 @@ namespace masutils
 		typedef typename triplet_list::reverse_iterator reverse_iterator;
 		typedef typename triplet_list::const_reverse_iterator const_reverse_iterator;
 
+		typedef buckets_observer<index_type, value_container> observer_type;
+
 		iterator begin() { return buckets_.begin(); }
 		iterator end() { return buckets_.end(); }
 		const_iterator begin() const noexcept { return const_iterator(buckets_.begin()); }
@@ -210,29 +304,138 @@ namespace masutils
 			return range_iterator<IsConst>(buckets_, end_range, end_range, iteration_direction::reverse);
 		}
 
+		// Point lookup: the bucket which contains index (low <= index < high),
+		// or end() if index falls in a gap or outside of all the buckets.
+		iterator find(index_type index)
+		{
+			iterator p = buckets_.begin();
+			while (p != buckets_.end() && !Traits::lt(index, p->second))
+				++p;
+			return (p != buckets_.end() && !Traits::lt(index, p->first)) ? p : buckets_.end();
+		}
+
+		const_iterator find(index_type index) const
+		{
+			const_iterator p = buckets_.begin();
+			while (p != buckets_.end() && !Traits::lt(index, p->second))
+				++p;
+			return (p != buckets_.end() && !Traits::lt(index, p->first)) ? p : buckets_.end();
+		}
+
+		// Batched point lookup: answers all of the points with one merged pass
+		// over the buckets instead of one search per point. The points do not
+		// need to be sorted (they are ordered internally if they are not), and
+		// out[i] is set to the bucket containing points[i] or end(). Returns the
+		// number of points which fell inside a bucket.
+		int find_batch(const std::vector<index_type>& points, std::vector<const_iterator>& out) const
+		{
+			out.assign(points.size(), buckets_.end());
+
+			const auto point_lt = [&points](std::size_t x_, std::size_t y_) {
+				return Traits::lt(points[x_], points[y_]);
+			};
+
+			std::vector<std::size_t> order(points.size());
+			std::iota(order.begin(), order.end(), std::size_t(0));
+			if (!std::is_sorted(order.begin(), order.end(), point_lt))
+				std::stable_sort(order.begin(), order.end(), point_lt);
+
+			int found = 0;
+			const_iterator p = buckets_.begin();
+			for (std::size_t i : order)
+			{
+				const index_type& index = points[i];
+				while (p != buckets_.end() && !Traits::lt(index, p->second))
+					++p;
+				if (p == buckets_.end())
+					break;
+				if (!Traits::lt(index, p->first))
+				{
+					out[i] = p;
+					found++;
+				}
+			}
+
+			return found;
+		}
+
+		// Build an immutable copy laid out for queries. Requires
+		// frozen_buckets.h to be included where freeze() is used.
+		frozen_buckets<Indices, Values, Traits, ContainerTraits> freeze(boundary_encoding encoding = boundary_encoding::full) const
+		{
+			return frozen_buckets<Indices, Values, Traits, ContainerTraits>(*this, encoding);
+		}
+
 		std::size_t size() const { return buckets_.size(); }
 		bool empty() const { return buckets_.empty(); }
 		index_type low() const { return low_; }
 		index_type high() const { return high_; }
 		bool constrained() const { return constrained_; }
 
+		// Attaches an observer (nullptr detaches it). The observer is not
+		// owned and must outlive its attachment. Without an observer each
+		// edit only pays for a null pointer check.
+		void observe(observer_type* observer) noexcept { observer_ = observer; }
+		observer_type* observer() const noexcept { return observer_; }
+
+		// The statistics kept by the Stats policy.
+		const stats_type& stats() const noexcept { return stats_; }
+
+		// Low boundary of the first bucket and high boundary of the last one;
+		// false when there are no buckets.
+		bool extent(index_type& low, index_type& high) const
+		{
+			if (buckets_.empty())
+				return false;
+			Traits::assign(low, buckets_.front().first);
+			Traits::assign(high, buckets_.back().second);
+			return true;
+		}
+
 	private:
 		buckets(const mytype&) = default;
 		mytype& operator=(const mytype&) = default;
 
+		// One change made to buckets_ while a batch is open, with what is
+		// needed to undo it
+		struct undo_entry
+		{
+			enum class kind { inserted, first_changed, values_appended, values_changed, erased };
+
+			kind what;
+			iterator position;      // the bucket changed, or the bucket after the erased ones
+			iterator removed;       // erased: the first of the erased buckets in the graveyard
+			index_type first;       // first_changed: the previous first
+			std::size_t size;       // values_appended: the previous number of values
+			value_container values; // values_changed: the previous values
+		};
+
 		triplet_list buckets_;
 		index_type low_;
 		index_type high_;
 		bool constrained_;
 
+		// buckets erased while a batch is open are kept here (in the order
+		// they were erased) until the batch is committed or rolled back
+		triplet_list graveyard_;
+		std::vector<undo_entry> undo_;
+		bool batching_;
+		// increased by every rollback, so that cursors can tell their
+		// position may be gone
+		std::size_t rollbacks_;
+
+		observer_type* observer_;
+
+		stats_type stats_;
+
 	public:
-		explicit buckets(index_type low, index_type high) : low_(low), high_(high), constrained_(true)
+		explicit buckets(index_type low, index_type high) : low_(low), high_(high), constrained_(true), batching_(false), rollbacks_(0), observer_(nullptr)
 		{
 			if (Traits::lt(high_, low_))
 				throw std::invalid_argument("Arguments not in correct order.");
 		}
 
-		explicit buckets() noexcept : low_(0), high_(0), constrained_(false)
+		explicit buckets() noexcept : low_(0), high_(0), constrained_(false), batching_(false), rollbacks_(0), observer_(nullptr)
 		{
 		}
 
@@ -240,8 +443,199 @@ namespace masutils
 		~buckets() = default; // Destructor
 		buckets& operator=(buckets&&) noexcept = default;
 
+		// Batches: every spread and cover made between begin_batch() and
+		// commit() is kept in an undo log, and rollback() reverts all of them
+		// at a cost proportional to the number of changes made (not to the
+		// number of buckets). Erased buckets are parked, not destroyed, so
+		// rolling back restores the very same nodes. Iterators to buckets
+		// which exist again after a rollback stay valid; iterators to
+		// buckets created during the batch do not (cursors notice and start
+		// over from the first bucket).
+		//
+		// Values appended with bucket_value_traits are logged as the previous
+		// size of the container and cut off again on rollback. Other
+		// container traits may change the values they hold in place (unique,
+		// most recent, running total), so their previous container is copied.
+		void begin_batch()
+		{
+			if (batching_)
+				throw std::logic_error("A batch is already open.");
+			batching_ = true;
+
+			if (observer_)
+				observer_->batch_begun();
+		}
+
+		void commit()
+		{
+			if (!batching_)
+				throw std::logic_error("No batch is open.");
+			undo_.clear();
+			graveyard_.clear();
+			batching_ = false;
+
+			if (observer_)
+				observer_->committed();
+		}
+
+		void rollback()
+		{
+			if (!batching_)
+				throw std::logic_error("No batch is open.");
+
+			// the extent of the buckets touched, before and after each undo
+			bool touched = false;
+			index_type low = index_type(), high = index_type();
+			auto extend = [&](const index_type& l, const index_type& h)
+			{
+				if (!touched || Traits::lt(l, low)) Traits::assign(low, l);
+				if (!touched || Traits::lt(high, h)) Traits::assign(high, h);
+				touched = true;
+			};
+
+			for (auto entry = undo_.rbegin(); entry != undo_.rend(); ++entry)
+			{
+				switch (entry->what)
+				{
+				case undo_entry::kind::inserted:
+					extend(entry->position->first, entry->position->second);
+					stats_.remove(*entry->position);
+					buckets_.erase(entry->position);
+					break;
+				case undo_entry::kind::first_changed:
+					extend(Traits::lt(entry->first, entry->position->first) ? entry->first : entry->position->first,
+						entry->position->second);
+					stats_.remove(*entry->position);
+					Traits::assign(entry->position->first, entry->first);
+					stats_.add(*entry->position);
+					break;
+				case undo_entry::kind::values_appended:
+					extend(entry->position->first, entry->position->second);
+					stats_.remove(*entry->position);
+					truncate(entry->position->third, entry->size);
+					stats_.add(*entry->position);
+					break;
+				case undo_entry::kind::values_changed:
+					extend(entry->position->first, entry->position->second);
+					stats_.remove(*entry->position);
+					entry->position->third = std::move(entry->values);
+					stats_.add(*entry->position);
+					break;
+				case undo_entry::kind::erased:
+					// the most recently erased buckets are at the end
+					for (iterator p = entry->removed; p != graveyard_.end(); ++p)
+					{
+						extend(p->first, p->second);
+						stats_.add(*p);
+					}
+					buckets_.splice(entry->position, graveyard_, entry->removed, graveyard_.end());
+					break;
+				}
+			}
+
+			undo_.clear();
+			graveyard_.clear();
+			batching_ = false;
+			rollbacks_++;
+
+			if (observer_)
+				observer_->rolled_back(low, high);
+		}
+
+		bool in_batch() const noexcept { return batching_; }
+
+	protected:
+		// Every change to buckets_ goes through one of these four so that a
+		// batch can record how to undo it.
+		iterator insert_bucket(iterator position, const triplet_type& triplet_)
+		{
+			iterator inserted = buckets_.insert(position, triplet_);
+			if (batching_)
+				log(undo_entry::kind::inserted, inserted);
+			stats_.add(*inserted);
+			return inserted;
+		}
+
+		void set_first(iterator position, const index_type& first)
+		{
+			if (batching_)
+				log(undo_entry::kind::first_changed, position).first = position->first;
+			stats_.remove(*position);
+			Traits::assign(position->first, first);
+			stats_.add(*position);
+		}
+
+		template <class other_value_container>
+		void append_values(iterator position, const other_value_container& values)
+		{
+			if (batching_)
+				log_values(position, appends_at_end<ContainerTraits>());
+			stats_.remove(*position);
+			ContainerTraits::append(position->third, values);
+			stats_.add(*position);
+		}
+
+		iterator erase_buckets(iterator first, iterator last)
+		{
+			for (iterator p = first; p != last; ++p)
+				stats_.remove(*p);
+
+			if (!batching_)
+				return buckets_.erase(first, last);
+			if (first == last)
+				return last;
+
+			undo_entry& entry = log(undo_entry::kind::erased, last);
+			graveyard_.splice(graveyard_.end(), buckets_, first, last);
+			entry.removed = first;
+			return last;
+		}
+
+		void split_at(const index_type& at, int& splits)
+		{
+			splits++;
+			if (observer_)
+				observer_->split(at);
+		}
+
+	private:
+		void log_values(iterator position, std::true_type)
+		{
+			log(undo_entry::kind::values_appended, position).size = position->third.size();
+		}
+
+		void log_values(iterator position, std::false_type)
+		{
+			log(undo_entry::kind::values_changed, position).values = position->third;
+		}
+
+		static void truncate(value_container& values, std::size_t size)
+		{
+			auto first = values.begin();
+			std::advance(first, size);
+			values.erase(first, values.end());
+		}
+
+		undo_entry& log(typename undo_entry::kind what, iterator position)
+		{
+			undo_.push_back(undo_entry());
+			undo_.back().what = what;
+			undo_.back().position = position;
+			return undo_.back();
+		}
+
 	protected:
 		bool splice(index_type low, index_type high, iterator& begin, iterator& end)
+		{
+			int splits = 0;
+			return splice(low, high, begin, end, buckets_.begin(), splits);
+		}
+
+		// hint may be any iterator of this bucket (including end()); the
+		// scan for the range starts from there instead of from begin().
+		// splits is increased by the number of cuts made in existing buckets
+		// (one per split_at).
+		bool splice(index_type low, index_type high, iterator& begin, iterator& end, iterator hint, int& splits)
 		{
 			index_type l, h;
 			Traits::assign(l, low);
@@ -262,8 +656,19 @@ namespace masutils
 			Traits::assign(lowest_, l);
 			Traits::assign(highest_, h);
 
+			// move the hint to the first bucket which does not end at or
+			// before l; every bucket before it is untouched by the range
+			while (hint != buckets_.begin() && Traits::lt(l, std::prev(hint)->second))
+				--hint;
+			while (hint != buckets_.end() && !Traits::lt(l, hint->second))
+				++hint;
+
+			// new buckets are only inserted after the bucket before the hint
+			const bool at_front = (hint == buckets_.begin());
+			const iterator before = at_front ? buckets_.end() : std::prev(hint);
+
 			// check for overlaps to slice buckets
-			for (iterator p = buckets_.begin(); p != buckets_.end(); ++p)
+			for (iterator p = hint; p != buckets_.end(); ++p)
 			{
 				if (Traits::lt(l, h) != true)
 					break; // all done since range is null
@@ -278,13 +683,13 @@ namespace masutils
 					if (Traits::lt(triplet.first, h)) // overlap
 					{
 						triplet_type _triplet(l, triplet.first, container_);
-						buckets_.insert(p, _triplet);
+						insert_bucket(p, _triplet);
 						Traits::assign(l, triplet.first);
 					}
 					else // no overlap
 					{
 						triplet_type _triplet(l, h, container_);
-						buckets_.insert(p, _triplet);
+						insert_bucket(p, _triplet);
 						Traits::assign(l, triplet.first);
 						continue; // it all ends before the current bucket
 						// so we're done
@@ -300,9 +705,10 @@ namespace masutils
 					{
 						triplet_type triplet_(triplet);
 						Traits::assign(triplet_.second, h);
-						buckets_.insert(p, triplet_);
-						Traits::assign(triplet.first, h);
+						insert_bucket(p, triplet_);
+						set_first(p, h);
 						Traits::assign(l, h);
+						split_at(h, splits);
 						continue;
 					}
 					else
@@ -323,10 +729,11 @@ namespace masutils
 						// _l" bucket
 						triplet_type triplet_(triplet);
 						Traits::assign(triplet_.second, l);
-						buckets_.insert(p, triplet_);
+						insert_bucket(p, triplet_);
 						// next change current bucket to be "_l to end of
 						// current bucket"
-						Traits::assign(triplet.first, l);
+						set_first(p, l);
+						split_at(l, splits);
 					}
 
 					// step 4: now isolate the part remaining which starts at
@@ -336,8 +743,9 @@ namespace masutils
 					{
 						triplet_type triplet_(triplet);
 						Traits::assign(triplet_.second, h);
-						buckets_.insert(p, triplet_);
-						Traits::assign(triplet.first, h);
+						insert_bucket(p, triplet_);
+						set_first(p, h);
+						split_at(h, splits);
 					}
 
 					// already have a bucket from l to triplet.second, adjust
@@ -353,13 +761,13 @@ namespace masutils
 			{
 				value_container container_;
 				triplet_type _triplet(l, h, container_);
-				buckets_.push_back(_triplet);
+				insert_bucket(buckets_.end(), _triplet);
 			}
 
 			bool b_begin = false, b_end = false;
 
 			{
-				for (iterator p = buckets_.begin(); p != buckets_.end(); ++p)
+				for (iterator p = at_front ? buckets_.begin() : std::next(before); p != buckets_.end(); ++p)
 				{
 					const triplet_type& triplet = *p;
 					if (Traits::eq(lowest_, triplet.first))
@@ -381,14 +789,25 @@ namespace masutils
 		}
 
 		int spread(const triplet_type& triplet_)
+		{
+			iterator begin, end;
+			int splits = 0;
+			return spread(triplet_, buckets_.begin(), begin, end, splits);
+		}
+
+		// begin and end are set to the buckets the value was added to (both
+		// are end() when nothing was added)
+		int spread(const triplet_type& triplet_, iterator hint, iterator& begin, iterator& end, int& splits)
 		{
 			int added_to_bucket = 0;
 
-			iterator begin, end;
-			const bool b_spliced = splice(triplet_.first, triplet_.second, begin, end);
+			const bool b_spliced = splice(triplet_.first, triplet_.second, begin, end, hint, splits);
 
 			if (!b_spliced)
+			{
+				begin = end = buckets_.end();
 				return added_to_bucket;
+			}
 
 			index_type l, h;
 			Traits::assign(l, triplet_.first);
@@ -413,24 +832,36 @@ namespace masutils
 				triplet_type& triplet = *p;
 				if (Traits::lt(triplet.second, l)) continue; // not yet...
 				if (Traits::lt(h, triplet.first)) break; // already done...
-				value_container& ocontainer_ = triplet.third;
-				const value_container& icontainer_ = triplet_.third;
-				ContainerTraits::append(ocontainer_, icontainer_);
+				append_values(p, triplet_.third);
 				added_to_bucket++;
 			}
 
+			if (observer_)
+				observer_->appended(l, h, triplet_.third);
+
 			return added_to_bucket;
 		}
 
 		int cover(const triplet_type& triplet_)
+		{
+			iterator begin, end;
+			int splits = 0;
+			return cover(triplet_, buckets_.begin(), begin, end, splits);
+		}
+
+		// begin and end are set to the new bucket (both are end() when
+		// nothing was covered)
+		int cover(const triplet_type& triplet_, iterator hint, iterator& begin, iterator& end, int& splits)
 		{
 			int added_to_bucket = 0;
 
-			iterator begin, end;
-			const bool b_spliced = splice(triplet_.first, triplet_.second, begin, end);
+			const bool b_spliced = splice(triplet_.first, triplet_.second, begin, end, hint, splits);
 
 			if (!b_spliced)
+			{
+				begin = end = buckets_.end();
 				return added_to_bucket;
+			}
 
 			index_type l, h;
 			Traits::assign(l, triplet_.first);
@@ -450,14 +881,18 @@ namespace masutils
 				if (Traits::lt(high_, h)) Traits::assign(h, high_);
 			}
 
-			iterator next = buckets_.erase(begin, end);
+			iterator next = erase_buckets(begin, end);
 
 			triplet_type triplet2_(l, h, triplet_.third);
 
-			buckets_.insert(next, triplet2_);
+			begin = insert_bucket(next, triplet2_);
+			end = next;
 
 			added_to_bucket++;
 
+			if (observer_)
+				observer_->covered(l, h, triplet_.third);
+
 			return added_to_bucket;
 		}
 
@@ -480,8 +915,120 @@ namespace masutils
 			return cover(triplet_);
 		}
 
-		template <class OtherContainerTraits>
-		int spread(const buckets<Indices, Values, Traits, OtherContainerTraits>& bucket_)
+		// Hinted forms: hint is any iterator of this bucket (end() is fine)
+		// which is expected to be near low. The search for the range starts
+		// at the hint and walks to it from there, so edits near the previous
+		// one do not rescan the buckets from the beginning.
+		int spread(iterator hint, index_type low, index_type high, value_type value)
+		{
+			edit_result result;
+			return spread(hint, low, high, value, result);
+		}
+
+		int cover(iterator hint, index_type low, index_type high, value_type value)
+		{
+			edit_result result;
+			return cover(hint, low, high, value, result);
+		}
+
+		// What an edit touched: the buckets [first, last) the value was added
+		// to by a spread, or the single new bucket of a cover, and the number
+		// of cuts made in existing buckets to line up with the range (one per
+		// end of the range which fell inside a bucket, so a bucket cut in
+		// three counts two).
+		// first == last == end() when the range was empty or outside of the
+		// constraints.
+		struct edit_result
+		{
+			iterator first;
+			iterator last;
+			int splits;
+		};
+
+		int spread(index_type low, index_type high, value_type value, edit_result& result)
+		{
+			return spread(buckets_.begin(), low, high, value, result);
+		}
+
+		int cover(index_type low, index_type high, value_type value, edit_result& result)
+		{
+			return cover(buckets_.begin(), low, high, value, result);
+		}
+
+		int spread(iterator hint, index_type low, index_type high, value_type value, edit_result& result)
+		{
+			value_container container_;
+			ContainerTraits::add(container_, value);
+			triplet_type triplet_(low, high, container_);
+
+			result.splits = 0;
+			return spread(triplet_, hint, result.first, result.last, result.splits);
+		}
+
+		int cover(iterator hint, index_type low, index_type high, value_type value, edit_result& result)
+		{
+			value_container container_;
+			ContainerTraits::add(container_, value);
+			triplet_type triplet_(low, high, container_);
+
+			result.splits = 0;
+			return cover(triplet_, hint, result.first, result.last, result.splits);
+		}
+
+		// A cursor remembers where its last edit happened and uses that as
+		// the hint for the next one, so a burst of edits around the same
+		// index only walks the distance between the edits. The position is
+		// a plain iterator: a cover through anything other than this cursor
+		// may erase it, call reset() after such an edit. A rollback may
+		// remove it too; the cursor notices that one by itself and starts
+		// over from the first bucket.
+		class cursor
+		{
+		public:
+			explicit cursor(mytype& owner) : owner_(&owner), position_(owner.buckets_.begin()), rollbacks_(owner.rollbacks_) {}
+
+			int spread(index_type low, index_type high, value_type value)
+			{
+				revalidate();
+				edit_result result;
+				const int added_to_bucket = owner_->spread(position_, low, high, value, result);
+				if (added_to_bucket > 0)
+					position_ = result.first;
+				return added_to_bucket;
+			}
+
+			int cover(index_type low, index_type high, value_type value)
+			{
+				revalidate();
+				edit_result result;
+				const int added_to_bucket = owner_->cover(position_, low, high, value, result);
+				if (added_to_bucket > 0)
+					position_ = result.first;
+				return added_to_bucket;
+			}
+
+			iterator position() const { return position_; }
+
+			void reset()
+			{
+				position_ = owner_->buckets_.begin();
+				rollbacks_ = owner_->rollbacks_;
+			}
+
+		private:
+			void revalidate()
+			{
+				if (rollbacks_ != owner_->rollbacks_)
+					reset();
+			}
+
+			mytype* owner_;
+			iterator position_;
+			std::size_t rollbacks_;
+		};
+
+		template <class OtherContainerTraits, class OtherStats>
+		int spread(const buckets<Indices, Values, Traits, OtherContainerTraits, OtherStats>& bucket_)
 		{
 			int added_to_bucket = 0;
 
@@ -494,8 +1041,8 @@ namespace masutils
 			return added_to_bucket;
 		}
 
-		template <class OtherContainerTraits>
-		int cover(const buckets<Indices, Values, Traits, OtherContainerTraits>& bucket_)
+		template <class OtherContainerTraits, class OtherStats>
+		int cover(const buckets<Indices, Values, Traits, OtherContainerTraits, OtherStats>& bucket_)
 		{
 			int added_to_bucket = 0;
 
@@ -0,0 +1,387 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// buckets_algo.h - Algorithms which work across two (or more) bucket collections
+
+#ifndef MASUTILS_BUCKETS_ALGO_H_
+#define MASUTILS_BUCKETS_ALGO_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDDEF_H_
+#include <cstddef>
+#endif // CSTDDEF_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef UTILITY_H_
+#include <utility>
+#endif // UTILITY_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+// overlap_join walks the (sorted) buckets of both collections at the same time
+// and calls the callback once for every fragment where a bucket of the left
+// collection overlaps a bucket of the right collection:
+//
+//     callback(low, high, left_values, right_values)
+//
+// Because both collections are already sorted by Traits, the sweep is linear in
+// the number of buckets of both collections and nothing is materialized. The
+// value types and container traits of the two collections may differ, but
+// both must use the same index type and the same Traits (otherwise their
+// orderings could not be merged). Returns the number of fragments reported.
+template <class LeftBucket, class RightBucket, class Callback>
+int overlap_join(const LeftBucket& left_, const RightBucket& right_, Callback callback)
+{
+	static_assert(std::is_same<typename LeftBucket::index_type, typename RightBucket::index_type>::value,
+		"overlap_join requires both buckets to have the same index_type");
+	static_assert(std::is_same<typename LeftBucket::traits_type, typename RightBucket::traits_type>::value,
+		"overlap_join requires both buckets to have the same Traits");
+
+	typedef typename LeftBucket::traits_type Traits;
+	typedef typename LeftBucket::index_type index_type;
+
+	int fragments = 0;
+
+	auto lp = left_.begin();
+	auto rp = right_.begin();
+
+	while (lp != left_.end() && rp != right_.end())
+	{
+		// the overlap (if any) is from the later of the two starts to the
+		// earlier of the two ends
+		const index_type& l = Traits::lt(lp->first, rp->first) ? rp->first : lp->first;
+		const index_type& h = Traits::lt(lp->second, rp->second) ? lp->second : rp->second;
+
+		if (Traits::lt(l, h))
+		{
+			callback(l, h, lp->third, rp->third);
+			fragments++;
+		}
+
+		// advance whichever bucket ends first; it cannot overlap anything
+		// further along in the other collection
+		if (Traits::lt(lp->second, rp->second))
+			++lp;
+		else if (Traits::lt(rp->second, lp->second))
+			++rp;
+		else
+		{
+			++lp;
+			++rp;
+		}
+	}
+
+	return fragments;
+}
+
+// A coverage_list is the pure geometry of a bucket collection: the sorted,
+// non-overlapping and non-adjacent extents which are covered by at least one
+// bucket. No values are kept.
+template <class Indices>
+using coverage_list = std::vector<std::pair<Indices, Indices>>;
+
+// coverage_reader reads the buckets of a collection as coverage extents,
+// joining buckets which touch (the end of one is the start of the next) into
+// a single extent.
+template <class BucketType>
+class coverage_reader
+{
+public:
+	typedef typename BucketType::index_type index_type;
+	typedef typename BucketType::traits_type traits_type;
+	typedef typename BucketType::const_iterator const_iterator;
+
+	explicit coverage_reader(const BucketType& bucket_)
+		: current_(bucket_.begin()), end_(bucket_.end()), valid_(false)
+	{
+		next();
+	}
+
+	bool valid() const noexcept { return valid_; }
+	const index_type& low() const noexcept { return low_; }
+	const index_type& high() const noexcept { return high_; }
+
+	void next()
+	{
+		valid_ = (current_ != end_);
+		if (!valid_)
+			return;
+
+		traits_type::assign(low_, current_->first);
+		traits_type::assign(high_, current_->second);
+
+		for (++current_; current_ != end_ && traits_type::eq(current_->first, high_); ++current_)
+			traits_type::assign(high_, current_->second);
+	}
+
+private:
+	const_iterator current_;
+	const_iterator end_;
+	index_type low_;
+	index_type high_;
+	bool valid_;
+};
+
+// Sweeps the coverage of both collections at the same time and appends to out
+// every extent where keep(covered_by_left, covered_by_right) is true. This is
+// the common engine of coverage_union, coverage_intersection and
+// coverage_difference; it is linear in the number of buckets and never touches
+// the value containers.
+template <class LeftBucket, class RightBucket, class KeepPredicate>
+int coverage_combine(const LeftBucket& left_,
+                     const RightBucket& right_,
+                     coverage_list<typename LeftBucket::index_type>& out,
+                     KeepPredicate keep)
+{
+	static_assert(std::is_same<typename LeftBucket::index_type, typename RightBucket::index_type>::value,
+		"coverage algebra requires both buckets to have the same index_type");
+	static_assert(std::is_same<typename LeftBucket::traits_type, typename RightBucket::traits_type>::value,
+		"coverage algebra requires both buckets to have the same Traits");
+
+	typedef typename LeftBucket::traits_type Traits;
+	typedef typename LeftBucket::index_type index_type;
+
+	const std::size_t initial_size = out.size();
+
+	coverage_reader<LeftBucket> lr(left_);
+	coverage_reader<RightBucket> rr(right_);
+
+	bool in_left = false, in_right = false, started = false;
+	index_type current = index_type();
+
+	while (lr.valid() || rr.valid())
+	{
+		// the next boundary is the closest one of: the start of the next
+		// extent (when outside of it) or the end of the current extent
+		// (when inside of it) of either collection
+		const index_type* next_ = nullptr;
+		if (lr.valid())
+			next_ = in_left ? &lr.high() : &lr.low();
+		if (rr.valid())
+		{
+			const index_type* r = in_right ? &rr.high() : &rr.low();
+			if (next_ == nullptr || Traits::lt(*r, *next_))
+				next_ = r;
+		}
+
+		index_type boundary;
+		Traits::assign(boundary, *next_);
+
+		// the state between the previous boundary and this one is constant
+		if (started && Traits::lt(current, boundary) && keep(in_left, in_right))
+		{
+			if (out.size() > initial_size && Traits::eq(out.back().second, current))
+				Traits::assign(out.back().second, boundary);
+			else
+				out.push_back(std::make_pair(current, boundary));
+		}
+
+		Traits::assign(current, boundary);
+		started = true;
+
+		if (lr.valid())
+		{
+			if (in_left)
+			{
+				if (Traits::eq(boundary, lr.high())) { in_left = false; lr.next(); }
+			}
+			else if (Traits::eq(boundary, lr.low()))
+				in_left = true;
+		}
+
+		if (rr.valid())
+		{
+			if (in_right)
+			{
+				if (Traits::eq(boundary, rr.high())) { in_right = false; rr.next(); }
+			}
+			else if (Traits::eq(boundary, rr.low()))
+				in_right = true;
+		}
+	}
+
+	return static_cast<int>(out.size() - initial_size);
+}
+
+// The extents covered by either collection.
+template <class LeftBucket, class RightBucket>
+int coverage_union(const LeftBucket& left_, const RightBucket& right_, coverage_list<typename LeftBucket::index_type>& out)
+{
+	return coverage_combine(left_, right_, out, [](bool l, bool r) { return l || r; });
+}
+
+// The extents covered by both collections.
+template <class LeftBucket, class RightBucket>
+int coverage_intersection(const LeftBucket& left_, const RightBucket& right_, coverage_list<typename LeftBucket::index_type>& out)
+{
+	return coverage_combine(left_, right_, out, [](bool l, bool r) { return l && r; });
+}
+
+// The extents covered by the left collection but not by the right collection.
+template <class LeftBucket, class RightBucket>
+int coverage_difference(const LeftBucket& left_, const RightBucket& right_, coverage_list<typename LeftBucket::index_type>& out)
+{
+	return coverage_combine(left_, right_, out, [](bool l, bool r) { return l && !r; });
+}
+
+// resample discretizes a bucket collection onto the fixed grid of bins
+// [origin + k * step, origin + (k + 1) * step) for k in [0, bins), e.g. per
+// 15 minute or per hour bins of a timeline. out is resized to bins (every bin
+// value initialized) and the buckets are walked once; for each run of bins a
+// bucket overlaps by the same length the reducer is called once:
+//
+//     reducer(first_bin, last_bin, values, length)
+//
+// where [first_bin, last_bin) points into out. A bucket spanning many bins
+// is thus one call for its whole bins plus at most two for its partial ends,
+// and the work is O(buckets + bins) instead of one range query per bin.
+// Parts of buckets outside of the grid are ignored.
+//
+// Requires an arithmetic index in ascending order (compare_traits). Works on
+// numeric_buckets too, whose values are plain numbers instead of containers.
+// Returns the number of buckets which touched the grid.
+template <class BucketType, class Bin, class Reducer>
+int resample(const BucketType& bucket_,
+             typename BucketType::index_type origin,
+             typename BucketType::index_type step,
+             std::size_t bins,
+             std::vector<Bin>& out,
+             Reducer reducer)
+{
+	typedef typename BucketType::index_type index_type;
+
+	static_assert(std::is_arithmetic<index_type>::value, "resample requires an arithmetic index_type");
+	static_assert(std::is_same<typename BucketType::traits_type, compare_traits<index_type>>::value,
+		"resample requires ascending compare_traits");
+
+	if (!(index_type() < step))
+		throw std::invalid_argument("Step must be positive.");
+
+	out.assign(bins, Bin());
+	if (bins == 0)
+		return 0;
+
+	Bin* const data = out.data();
+	const index_type end = origin + static_cast<index_type>(bins) * step;
+	int touched = 0;
+
+	for (auto p = bucket_.begin(); p != bucket_.end(); ++p)
+	{
+		if (!(origin < p->second))
+			continue;
+		if (!(p->first < end))
+			break;
+
+		const index_type l = p->first < origin ? origin : p->first;
+		const index_type h = end < p->second ? end : p->second;
+		touched++;
+
+		std::size_t k = static_cast<std::size_t>((l - origin) / step);
+		const index_type bin_low = origin + static_cast<index_type>(k) * step;
+
+		// partial first bin
+		if (bin_low < l)
+		{
+			const index_type bin_high = bin_low + step;
+			reducer(data + k, data + k + 1, p->third, (h < bin_high ? h : bin_high) - l);
+			if (!(bin_high < h))
+				continue;
+			++k;
+		}
+
+		// whole bins [k, last), then the partial last bin (if any)
+		const std::size_t last = static_cast<std::size_t>((h - origin) / step);
+		if (k < last)
+			reducer(data + k, data + last, p->third, step);
+
+		if (last < bins)
+		{
+			const index_type rest = h - (origin + static_cast<index_type>(last) * step);
+			if (index_type() < rest)
+				reducer(data + last, data + last + 1, p->third, rest);
+		}
+	}
+
+	return touched;
+}
+
+// Reducer for resample: each bin receives the integral of the bucket amounts
+// (the sum of the values of a bucket) over the bin, that is every bucket adds
+// its amount times the length of its overlap. Divide by step for the time
+// weighted average of a bin. The per run loop is a plain add of a constant,
+// which the compiler vectorizes.
+template <class Number>
+struct length_weighted_reducer
+{
+	template <class Values, class Index>
+	void operator()(Number* first, Number* last, const Values& values, const Index& length) const
+	{
+		const Number amount = amount_of(values, std::is_arithmetic<Values>()) * static_cast<Number>(length);
+		for (; first != last; ++first)
+			*first += amount;
+	}
+
+private:
+	// numeric_buckets hand over their (single) number directly
+	template <class Values>
+	static Number amount_of(const Values& value, std::true_type)
+	{
+		return static_cast<Number>(value);
+	}
+
+	template <class Values>
+	static Number amount_of(const Values& values, std::false_type)
+	{
+		Number amount = Number();
+		for (auto v = values.begin(); v != values.end(); ++v)
+			amount += static_cast<Number>(*v);
+		return amount;
+	}
+};
+
+// Reducer for resample: each bin receives the values of every bucket which
+// overlaps it, combined by ContainerTraits::append; with
+// unique_bucket_value_traits this is the set of values seen in the bin (e.g.
+// who was on shift during each 15 minutes). The bins are
+// ContainerTraits::value_container.
+template <class ContainerTraits>
+struct container_union_reducer
+{
+	typedef typename ContainerTraits::value_container value_container;
+
+	template <class Values, class Index>
+	void operator()(value_container* first, value_container* last, const Values& values, const Index&) const
+	{
+		for (; first != last; ++first)
+			ContainerTraits::append(*first, values);
+	}
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_BUCKETS_ALGO_H_
@@ -39,7 +39,8 @@
 
 namespace masutils {
 
-template<class E, class C = std::vector<E> >
+// Only ever holds a single value, which is kept inline in the bucket.
+template<class E, class C = small_vector<E, 1> >
 struct most_recent_bucket_value_traits {
 
 	typedef E  value_type;
@@ -64,7 +65,9 @@ protected:
 	~most_recent_bucket_value_traits() = default;
 };
 
-template<class E, class C = std::vector<E> >
+// Only ever holds a single (running total) value, which is kept inline in
+// the bucket.
+template<class E, class C = small_vector<E, 1> >
 struct bucket_value_add_traits {
 
 	typedef E  value_type;
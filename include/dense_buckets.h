@@ -0,0 +1,392 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// dense_buckets.h - Direct indexed bucket collection for small integral domains
+
+#ifndef MASUTILS_DENSE_BUCKETS_H_
+#define MASUTILS_DENSE_BUCKETS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // CSTDINT_H_
+
+#ifndef ITERATOR_H_
+#include <iterator>
+#endif // ITERATOR_H_
+
+#ifndef LIMITS_H_
+#include <limits>
+#endif // LIMITS_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef UTILITY_H_
+#include <utility>
+#endif // UTILITY_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+// A dense_buckets has the same spread/cover semantics as buckets, but is meant
+// for integral indices whose (constrained) range is small: a char, or the
+// minutes of a day. Every unit of the range has an entry in a lookup table
+// which holds the id of the value container of the bucket the unit belongs to
+// (or no_bucket for a gap), and every container id knows the first and last
+// unit of its bucket. Each bucket has its own container id, so a bucket
+// boundary is simply a unit whose id differs from the id of the unit before
+// it. find() is a single table lookup, and spread() and cover() only touch the
+// units they affect (plus the tail of a bucket which has to be split); there
+// is no search at all.
+//
+// Iterating yields lightweight bucket views with the same first, second and
+// third members as the triplets of buckets.
+//
+// This is a separate class, not a specialization of buckets: the table and
+// the per bucket extents have nothing in common with the list buckets keeps,
+// so a specialization would have had to reimplement every member anyway, and
+// code written against buckets could not have relied on it being selected.
+// Choose it explicitly where the range is known to be small. It only has the
+// core of the buckets interface (the two constructors, begin/end, find, size,
+// empty, low, high, constrained and spread/cover of a single value). Missing
+// compared to buckets are:
+//  - batches: begin_batch, commit, rollback, in_batch
+//  - observers and statistics: observe, observer, the Stats policy, stats
+//  - hinted edits and edit_result: the spread/cover overloads taking an
+//    iterator hint or an edit_result, and cursor
+//  - spread/cover of a triplet or of another collection
+//  - mutable and reverse iteration, beginRange/endRange and their reverse
+//    forms, find_batch, extent and freeze
+//  - copying
+template <class Indices,
+          class Values,
+          class Traits = compare_traits<Indices>,
+          class ContainerTraits = bucket_value_traits<Values>>
+class dense_buckets
+{
+	static_assert(std::is_integral<Indices>::value && sizeof(Indices) <= sizeof(long long),
+		"dense_buckets requires an integral index type");
+	static_assert(std::is_same<Traits, compare_traits<Indices>>::value ||
+	              std::is_same<Traits, compare_traits_descending<Indices>>::value,
+		"dense_buckets requires compare_traits or compare_traits_descending");
+
+public:
+	typedef dense_buckets<Indices,
+	                      Values,
+	                      Traits,
+	                      ContainerTraits> mytype;
+
+	typedef Indices index_type;
+	typedef Values value_type;
+
+	typedef Traits traits_type;
+	typedef ContainerTraits container_traits;
+
+	typedef typename ContainerTraits::value_container value_container;
+
+	// largest number of units the lookup table is allowed to have
+	static constexpr std::size_t max_span = std::size_t(1) << 20;
+
+	struct bucket_view
+	{
+		index_type first;
+		index_type second;
+		const value_container& third;
+	};
+
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef bucket_view value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const bucket_view* pointer;
+		typedef bucket_view reference;
+
+		struct arrow_proxy
+		{
+			bucket_view view;
+			const bucket_view* operator->() const noexcept { return &view; }
+		};
+
+		const_iterator(const mytype* owner, std::size_t start) : owner_(owner), start_(start), end_(start)
+		{
+			seek();
+		}
+
+		bucket_view operator*() const
+		{
+			return bucket_view{ owner_->index_of(start_), owner_->index_of(end_), owner_->containers_[owner_->slots_[start_]] };
+		}
+
+		arrow_proxy operator->() const { return arrow_proxy{ **this }; }
+
+		const_iterator& operator++()
+		{
+			start_ = end_;
+			seek();
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator previous(*this);
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const const_iterator& other) const { return start_ == other.start_; }
+		bool operator!=(const const_iterator& other) const { return start_ != other.start_; }
+
+	private:
+		// skips any gap at start_, then looks up the end of the bucket
+		void seek()
+		{
+			const std::size_t span = owner_->slots_.size();
+			while (start_ < span && owner_->slots_[start_] == no_bucket)
+				++start_;
+			end_ = (start_ < span) ? owner_->extents_[owner_->slots_[start_]].second : span;
+		}
+
+		const mytype* owner_;
+		std::size_t start_;
+		std::size_t end_;
+	};
+
+	typedef const_iterator iterator;
+
+	explicit dense_buckets(index_type low, index_type high) : low_(low), high_(high), constrained_(true), count_(0)
+	{
+		if (Traits::lt(high_, low_))
+			throw std::invalid_argument("Arguments not in correct order.");
+		allocate();
+	}
+
+	// Unconstrained: covers the whole domain of a one or two byte index type.
+	explicit dense_buckets()
+		: low_(descending ? std::numeric_limits<index_type>::max() : std::numeric_limits<index_type>::min()),
+		  high_(descending ? std::numeric_limits<index_type>::min() : std::numeric_limits<index_type>::max()),
+		  constrained_(false), count_(0)
+	{
+		static_assert(sizeof(Indices) <= 2, "unconstrained dense_buckets requires a one or two byte index type");
+		allocate();
+	}
+
+	~dense_buckets() = default;
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, slots_.size()); }
+
+	// The bucket which contains index, or end().
+	const_iterator find(index_type index) const
+	{
+		if (Traits::lt(index, low_) || !Traits::lt(index, high_))
+			return end();
+		const std::uint32_t id = slots_[unit_of(index)];
+		if (id == no_bucket)
+			return end();
+		return const_iterator(this, extents_[id].first);
+	}
+
+	std::size_t size() const noexcept { return count_; }
+	bool empty() const noexcept { return count_ == 0; }
+	index_type low() const { return low_; }
+	index_type high() const { return high_; }
+	bool constrained() const noexcept { return constrained_; }
+
+	int spread(index_type low, index_type high, value_type value)
+	{
+		std::size_t a, b;
+		if (!clamp(low, high, a, b))
+			return 0;
+
+		value_container container_;
+		ContainerTraits::add(container_, value);
+
+		split(a);
+		split(b);
+
+		int added_to_bucket = 0;
+		for (std::size_t u = a; u < b; )
+		{
+			std::size_t v = u;
+			if (slots_[u] == no_bucket)
+			{
+				// a gap becomes a new bucket
+				const std::uint32_t id = acquire();
+				while (v < b && slots_[v] == no_bucket)
+					slots_[v++] = id;
+				extents_[id] = extent(u, v);
+				ContainerTraits::append(containers_[id], container_);
+				count_++;
+			}
+			else
+			{
+				// after the splits the bucket ends at or before b
+				const std::uint32_t id = slots_[u];
+				v = extents_[id].second;
+				ContainerTraits::append(containers_[id], container_);
+			}
+			added_to_bucket++;
+			u = v;
+		}
+
+		return added_to_bucket;
+	}
+
+	int cover(index_type low, index_type high, value_type value)
+	{
+		std::size_t a, b;
+		if (!clamp(low, high, a, b))
+			return 0;
+
+		split(a);
+		split(b);
+
+		for (std::size_t u = a; u < b; )
+		{
+			const std::uint32_t id = slots_[u];
+			if (id == no_bucket)
+				++u;
+			else
+			{
+				u = extents_[id].second;
+				release(id);
+				count_--;
+			}
+		}
+
+		const std::uint32_t id = acquire();
+		ContainerTraits::add(containers_[id], value);
+		for (std::size_t u = a; u < b; ++u)
+			slots_[u] = id;
+		extents_[id] = extent(a, b);
+		count_++;
+
+		return 1;
+	}
+
+private:
+	dense_buckets(const mytype&) = delete;
+	mytype& operator=(const mytype&) = delete;
+
+	static constexpr std::uint32_t no_bucket = std::numeric_limits<std::uint32_t>::max();
+	static constexpr bool descending = std::is_same<Traits, compare_traits_descending<Indices>>::value;
+
+	void allocate()
+	{
+		const long long span = distance(low_, high_);
+		if (span < 0 || static_cast<unsigned long long>(span) > max_span)
+			throw std::length_error("Range is too large for dense_buckets.");
+		slots_.assign(static_cast<std::size_t>(span), no_bucket);
+	}
+
+	static long long distance(index_type from, index_type to)
+	{
+		return descending
+			? static_cast<long long>(from) - static_cast<long long>(to)
+			: static_cast<long long>(to) - static_cast<long long>(from);
+	}
+
+	std::size_t unit_of(index_type index) const { return static_cast<std::size_t>(distance(low_, index)); }
+
+	index_type index_of(std::size_t unit) const
+	{
+		return descending
+			? static_cast<index_type>(static_cast<long long>(low_) - static_cast<long long>(unit))
+			: static_cast<index_type>(static_cast<long long>(low_) + static_cast<long long>(unit));
+	}
+
+	// restrict [low, high) to the constraints and convert it to units
+	bool clamp(index_type low, index_type high, std::size_t& a, std::size_t& b) const
+	{
+		if (!Traits::lt(low, high))
+			return false;
+		if (Traits::lt(high, low_) || Traits::lt(high_, low))
+			return false;
+		if (Traits::lt(low, low_)) low = low_;
+		if (Traits::lt(high_, high)) high = high_;
+		a = unit_of(low);
+		b = unit_of(high);
+		return a < b;
+	}
+
+	// makes unit the first unit of a bucket (when it is inside of one) by
+	// moving the rest of the bucket to a copy of its container
+	void split(std::size_t unit)
+	{
+		if (unit == 0 || unit >= slots_.size())
+			return;
+		const std::uint32_t id = slots_[unit];
+		if (id == no_bucket || slots_[unit - 1] != id)
+			return;
+
+		const std::uint32_t copy = acquire();
+		containers_[copy] = containers_[id];
+		extents_[copy] = extent(unit, extents_[id].second);
+		extents_[id].second = unit;
+		for (std::size_t u = unit; u < extents_[copy].second; ++u)
+			slots_[u] = copy;
+		count_++;
+	}
+
+	std::uint32_t acquire()
+	{
+		if (!free_.empty())
+		{
+			const std::uint32_t id = free_.back();
+			free_.pop_back();
+			return id;
+		}
+		containers_.push_back(value_container());
+		extents_.push_back(extent(0, 0));
+		return static_cast<std::uint32_t>(containers_.size() - 1);
+	}
+
+	void release(std::uint32_t id)
+	{
+		containers_[id] = value_container();
+		free_.push_back(id);
+	}
+
+	// first unit and one past the last unit of the bucket of a container id
+	typedef std::pair<std::size_t, std::size_t> extent;
+
+	std::vector<std::uint32_t> slots_;
+	std::vector<value_container> containers_;
+	std::vector<extent> extents_;
+	std::vector<std::uint32_t> free_;
+	index_type low_;
+	index_type high_;
+	bool constrained_;
+	std::size_t count_;
+};
+
+template <class Indices, class Values, class Traits, class ContainerTraits>
+constexpr std::size_t dense_buckets<Indices, Values, Traits, ContainerTraits>::max_span;
+
+template <class Indices, class Values, class Traits, class ContainerTraits>
+constexpr std::uint32_t dense_buckets<Indices, Values, Traits, ContainerTraits>::no_bucket;
+
+} // namespace masutils
+
+#endif // MASUTILS_DENSE_BUCKETS_H_
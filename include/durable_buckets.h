@@ -0,0 +1,528 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// durable_buckets.h - Write-ahead logged and checkpointed buckets
+
+#ifndef MASUTILS_DURABLE_BUCKETS_H_
+#define MASUTILS_DURABLE_BUCKETS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // CSTDINT_H_
+
+#ifndef CSTDIO_H_
+#include <cstdio>
+#endif // CSTDIO_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef STRING_H_
+#include <string>
+#endif // STRING_H_
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <share.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "bucket_codec.h"
+
+namespace masutils {
+
+// A durable_buckets is a buckets whose edits survive a restart. Every spread
+// and cover is appended to a write-ahead log (path + ".wal") as it is made.
+// The log is written and synced to disk once every group_size edits (group
+// commit) or when flush() is called; edits made since the last flush are the
+// ones which can be lost. Every checkpoint_interval edits (or when
+// checkpoint() is called) the whole collection is written to a checkpoint
+// (path + ".ckpt") and the log is emptied, so recovering never replays more
+// than one checkpoint interval of edits.
+//
+// Opening a durable_buckets recovers the latest checkpoint plus the edits
+// logged after it. Every log record carries a sequence number and a
+// checksum: a torn record at the end of the log is ignored, and records
+// already contained in the checkpoint are skipped. A new checkpoint is
+// written to a temporary file, synced, renamed over the old one and the
+// directory is synced before the log is emptied, so the log is only lost once
+// the checkpoint holding its edits is on disk. (Windows has no way to sync a
+// directory; there the rename relies on the metadata journal of NTFS.)
+//
+// Indices and values are stored with bucket_codec. The value container of
+// each bucket is restored by covering the bucket with its first value and
+// spreading the others, which rebuilds the same container for all of the
+// value traits of this library. A bucket whose container is empty (only
+// possible with value traits which drop values) cannot be rebuilt that way
+// and is not kept across a restart.
+//
+// A failed write of the log (flush() throws std::runtime_error) cuts the log
+// back to the records written before it, so that the edits are written again
+// by the next flush instead of after a torn record, which would end the
+// replay there. If the log cannot be cut back either, it is not written to
+// again: flush() keeps throwing until checkpoint() succeeds, which writes
+// every edit (the ones not logged too) and starts a new log.
+template <class Bucket>
+class durable_buckets
+{
+public:
+	typedef Bucket bucket_type;
+	typedef typename Bucket::index_type index_type;
+	typedef typename Bucket::value_type value_type;
+
+	// Constrained to [low, high); a checkpoint with other constraints is
+	// rejected with std::runtime_error.
+	durable_buckets(const std::string& path, index_type low, index_type high,
+		std::size_t group_size = 64, std::size_t checkpoint_interval = 65536)
+		: bucket_(low, high), path_(path), group_size_(group_size), checkpoint_interval_(checkpoint_interval)
+	{
+		recover();
+	}
+
+	explicit durable_buckets(const std::string& path,
+		std::size_t group_size = 64, std::size_t checkpoint_interval = 65536)
+		: bucket_(), path_(path), group_size_(group_size), checkpoint_interval_(checkpoint_interval)
+	{
+		recover();
+	}
+
+	durable_buckets(const durable_buckets&) = delete;
+	durable_buckets& operator=(const durable_buckets&) = delete;
+
+	~durable_buckets()
+	{
+		try
+		{
+			flush();
+		}
+		catch (...)
+		{
+			// nothing can be reported from a destructor; the unflushed
+			// edits are lost just like after a crash
+		}
+		if (log_)
+			std::fclose(log_);
+	}
+
+	int spread(index_type low, index_type high, value_type value)
+	{
+		append(record_kind::spread, low, high, value);
+		const int added_to_bucket = bucket_.spread(low, high, value);
+		committed();
+		return added_to_bucket;
+	}
+
+	int cover(index_type low, index_type high, value_type value)
+	{
+		append(record_kind::cover, low, high, value);
+		const int added_to_bucket = bucket_.cover(low, high, value);
+		committed();
+		return added_to_bucket;
+	}
+
+	// Writes the pending log records and syncs the log to disk.
+	void flush()
+	{
+		if (!log_)
+			throw std::runtime_error("The bucket log is unusable after a failed write; a checkpoint is needed.");
+		if (pending_.empty())
+			return;
+		try
+		{
+			write(log_, pending_, "Cannot write the bucket log.");
+		}
+		catch (...)
+		{
+			discard_torn_write();
+			throw;
+		}
+		log_size_ += pending_.size();
+		pending_.clear();
+		pending_records_ = 0;
+	}
+
+	// Writes the whole collection to a new checkpoint and empties the log.
+	void checkpoint()
+	{
+		if (log_)
+			flush();
+
+		std::string body;
+		encode(body, checkpoint_magic);
+		encode(body, checkpoint_version);
+		encode(body, sequence_);
+		encode(body, bucket_.low());
+		encode(body, bucket_.high());
+		encode(body, static_cast<std::uint8_t>(bucket_.constrained() ? 1 : 0));
+		encode(body, static_cast<std::uint64_t>(bucket_.size()));
+		for (auto p = bucket_.begin(); p != bucket_.end(); ++p)
+		{
+			encode(body, p->first);
+			encode(body, p->second);
+			std::uint32_t count = 0;
+			for (auto v = p->third.begin(); v != p->third.end(); ++v)
+				count++;
+			encode(body, count);
+			for (auto v = p->third.begin(); v != p->third.end(); ++v)
+				encode(body, *v);
+		}
+		encode(body, codec_checksum(body.data(), body.size()));
+
+		// the new checkpoint only replaces the old one once it is complete
+		const std::string temporary = checkpoint_path() + ".tmp";
+		std::FILE* file = open(temporary, "wb");
+		try
+		{
+			write(file, body, "Cannot write the bucket checkpoint.");
+		}
+		catch (...)
+		{
+			std::fclose(file);
+			throw;
+		}
+		std::fclose(file);
+
+#if defined(_WIN32)
+		// rename does not replace an existing file on Windows; if a crash
+		// happens in between, recovery falls back to the temporary file
+		std::remove(checkpoint_path().c_str());
+#endif
+		if (std::rename(temporary.c_str(), checkpoint_path().c_str()) != 0)
+			throw std::runtime_error("Cannot replace the bucket checkpoint.");
+		sync_directory(checkpoint_path());
+
+		// every edit is in the checkpoint now, logged or not
+		if (log_)
+			std::fclose(log_);
+		log_ = nullptr;
+		log_ = open(log_path(), "wb");
+		log_size_ = 0;
+		pending_.clear();
+		pending_records_ = 0;
+		since_checkpoint_ = 0;
+	}
+
+	const bucket_type& buckets() const noexcept { return bucket_; }
+
+	// sequence number of the most recent edit (0 before the first one)
+	std::uint64_t sequence() const noexcept { return sequence_; }
+
+	// number of edits which are not yet written to the log
+	std::size_t pending() const noexcept { return pending_records_; }
+
+	std::string log_path() const { return path_ + ".wal"; }
+	std::string checkpoint_path() const { return path_ + ".ckpt"; }
+
+private:
+	enum class record_kind : std::uint8_t { spread = 1, cover = 2 };
+
+	static constexpr std::uint32_t checkpoint_magic = 0x4253414d; // "MASB"
+	static constexpr std::uint32_t checkpoint_version = 1;
+
+	// log record: payload size, payload checksum, payload (sequence number,
+	// kind, low, high, value)
+	void append(record_kind kind, const index_type& low, const index_type& high, const value_type& value)
+	{
+		std::string payload;
+		encode(payload, sequence_ + 1);
+		encode(payload, static_cast<std::uint8_t>(kind));
+		encode(payload, low);
+		encode(payload, high);
+		encode(payload, value);
+
+		encode(pending_, static_cast<std::uint32_t>(payload.size()));
+		encode(pending_, codec_checksum(payload.data(), payload.size()));
+		pending_ += payload;
+		pending_records_++;
+		sequence_++;
+	}
+
+	void committed()
+	{
+		if (checkpoint_interval_ > 0 && ++since_checkpoint_ >= checkpoint_interval_)
+			checkpoint();
+		else if (pending_records_ >= group_size_)
+			flush();
+	}
+
+	void recover()
+	{
+		// the checkpoint, or the temporary one when a crash happened while
+		// it was being replaced (whichever is more recent)
+		std::string body;
+		std::uint64_t checkpoint_sequence = 0;
+		bool found = load_checkpoint(checkpoint_path(), body, checkpoint_sequence);
+		{
+			std::string temporary;
+			std::uint64_t temporary_sequence = 0;
+			if (load_checkpoint(checkpoint_path() + ".tmp", temporary, temporary_sequence) &&
+			    (!found || checkpoint_sequence < temporary_sequence))
+			{
+				body.swap(temporary);
+				checkpoint_sequence = temporary_sequence;
+				found = true;
+			}
+		}
+
+		if (found)
+			restore(body);
+		sequence_ = checkpoint_sequence;
+
+		std::string log;
+		const bool replay = read_file(log_path(), log) && !log.empty();
+		if (replay)
+			replay_log(log);
+
+		// a replayed log (and any torn record at its end) is folded into a
+		// fresh checkpoint
+		if (replay)
+			checkpoint();
+		else
+			log_ = open(log_path(), "ab");
+	}
+
+	// After a failed write the log may end in part of the pending records
+	// (and more of them may still sit in the buffer of log_): the file is
+	// closed, cut back to the records which were written whole and opened
+	// again. When that fails, log_ is left null and the log is not used
+	// until the next checkpoint.
+	void discard_torn_write() noexcept
+	{
+		std::fclose(log_);
+		log_ = nullptr;
+
+		const std::string path = log_path();
+#if defined(_WIN32)
+		int descriptor = -1;
+		if (_sopen_s(&descriptor, path.c_str(), _O_RDWR | _O_BINARY, _SH_DENYNO, _S_IREAD | _S_IWRITE) != 0)
+			return;
+		const bool truncated = _chsize_s(descriptor, static_cast<__int64>(log_size_)) == 0 && _commit(descriptor) == 0;
+		_close(descriptor);
+#else
+		const int descriptor = ::open(path.c_str(), O_WRONLY);
+		if (descriptor < 0)
+			return;
+		const bool truncated = ftruncate(descriptor, static_cast<off_t>(log_size_)) == 0 && fsync(descriptor) == 0;
+		::close(descriptor);
+#endif
+		if (!truncated)
+			return;
+
+		try
+		{
+			log_ = open(path, "ab");
+		}
+		catch (...)
+		{
+			log_ = nullptr;
+		}
+	}
+
+	static bool load_checkpoint(const std::string& path, std::string& body, std::uint64_t& sequence)
+	{
+		if (!read_file(path, body) || body.size() < sizeof(std::uint32_t))
+			return false;
+
+		const char* p = body.data() + body.size() - sizeof(std::uint32_t);
+		std::uint32_t checksum;
+		decode(p, body.data() + body.size(), checksum);
+		body.resize(body.size() - sizeof(std::uint32_t));
+		if (checksum != codec_checksum(body.data(), body.size()))
+			return false;
+
+		p = body.data();
+		const char* end = body.data() + body.size();
+		std::uint32_t magic, version;
+		return decode(p, end, magic) && magic == checkpoint_magic &&
+		       decode(p, end, version) && version == checkpoint_version &&
+		       decode(p, end, sequence);
+	}
+
+	void restore(const std::string& body)
+	{
+		const char* p = body.data();
+		const char* end = body.data() + body.size();
+
+		std::uint32_t magic, version;
+		std::uint64_t sequence, count;
+		index_type low, high;
+		std::uint8_t constrained;
+		decode(p, end, magic);
+		decode(p, end, version);
+		decode(p, end, sequence);
+		if (!decode(p, end, low) || !decode(p, end, high) || !decode(p, end, constrained) || !decode(p, end, count))
+			throw std::runtime_error("Bucket checkpoint is corrupt.");
+
+		if ((constrained != 0) != bucket_.constrained() ||
+		    (bucket_.constrained() && (!bucket_type::traits_type::eq(low, bucket_.low()) ||
+		                               !bucket_type::traits_type::eq(high, bucket_.high()))))
+			throw std::runtime_error("Bucket checkpoint does not match the bucket constraints.");
+
+		// the buckets are in order, so the cursor never has to search
+		typename bucket_type::cursor cursor(bucket_);
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			index_type first, second;
+			std::uint32_t values;
+			if (!decode(p, end, first) || !decode(p, end, second) || !decode(p, end, values))
+				throw std::runtime_error("Bucket checkpoint is corrupt.");
+			for (std::uint32_t v = 0; v < values; ++v)
+			{
+				value_type value;
+				if (!decode(p, end, value))
+					throw std::runtime_error("Bucket checkpoint is corrupt.");
+				if (v == 0)
+					cursor.cover(first, second, value);
+				else
+					cursor.spread(first, second, value);
+			}
+		}
+	}
+
+	// applies the records after the checkpoint, up to the first torn one
+	void replay_log(const std::string& log)
+	{
+		const char* p = log.data();
+		const char* end = log.data() + log.size();
+		while (p != end)
+		{
+			std::uint32_t size, checksum;
+			if (!decode(p, end, size) || !decode(p, end, checksum) ||
+			    static_cast<std::size_t>(end - p) < size || checksum != codec_checksum(p, size))
+				break;
+
+			const char* q = p;
+			const char* record_end = p + size;
+			p = record_end;
+
+			std::uint64_t sequence;
+			std::uint8_t kind;
+			index_type low, high;
+			value_type value;
+			if (!decode(q, record_end, sequence) || !decode(q, record_end, kind) ||
+			    !decode(q, record_end, low) || !decode(q, record_end, high) || !decode(q, record_end, value))
+				break;
+
+			if (sequence <= sequence_)
+				continue; // already in the checkpoint
+
+			if (kind == static_cast<std::uint8_t>(record_kind::cover))
+				bucket_.cover(low, high, value);
+			else
+				bucket_.spread(low, high, value);
+			sequence_ = sequence;
+		}
+	}
+
+	static std::FILE* open(const std::string& path, const char* mode)
+	{
+		std::FILE* file = nullptr;
+#if defined(_MSC_VER)
+		if (fopen_s(&file, path.c_str(), mode) != 0)
+			file = nullptr;
+#else
+		file = std::fopen(path.c_str(), mode);
+#endif
+		if (!file)
+			throw std::runtime_error("Cannot open " + path + ".");
+		return file;
+	}
+
+	static bool read_file(const std::string& path, std::string& contents)
+	{
+		std::FILE* file = nullptr;
+#if defined(_MSC_VER)
+		if (fopen_s(&file, path.c_str(), "rb") != 0)
+			file = nullptr;
+#else
+		file = std::fopen(path.c_str(), "rb");
+#endif
+		if (!file)
+			return false;
+
+		contents.clear();
+		char buffer[65536];
+		std::size_t read;
+		while ((read = std::fread(buffer, 1, sizeof(buffer), file)) > 0)
+			contents.append(buffer, read);
+		std::fclose(file);
+		return true;
+	}
+
+	// writes data and makes sure it reached the disk
+	static void write(std::FILE* file, const std::string& data, const char* message)
+	{
+		if (std::fwrite(data.data(), 1, data.size(), file) != data.size() || std::fflush(file) != 0)
+			throw std::runtime_error(message);
+#if defined(_WIN32)
+		if (_commit(_fileno(file)) != 0)
+#else
+		if (fsync(fileno(file)) != 0)
+#endif
+			throw std::runtime_error(message);
+	}
+
+	// makes a rename in the directory of path durable
+	static void sync_directory(const std::string& path)
+	{
+#if defined(_WIN32)
+		(void)path;
+#else
+		const std::string::size_type slash = path.find_last_of('/');
+		const std::string directory = slash == std::string::npos ? std::string(".")
+			: slash == 0 ? std::string("/") : path.substr(0, slash);
+
+		const int descriptor = ::open(directory.c_str(), O_RDONLY);
+		if (descriptor < 0)
+			throw std::runtime_error("Cannot open " + directory + ".");
+		const int result = fsync(descriptor);
+		::close(descriptor);
+		if (result != 0)
+			throw std::runtime_error("Cannot sync " + directory + ".");
+#endif
+	}
+
+	bucket_type bucket_;
+	std::string path_;
+	std::size_t group_size_;
+	std::size_t checkpoint_interval_;
+
+	// null when the log cannot be written to until the next checkpoint
+	std::FILE* log_ = nullptr;
+	// bytes of whole records in the log
+	std::uint64_t log_size_ = 0;
+	std::string pending_;
+	std::size_t pending_records_ = 0;
+	std::size_t since_checkpoint_ = 0;
+	std::uint64_t sequence_ = 0;
+};
+
+template <class Bucket>
+constexpr std::uint32_t durable_buckets<Bucket>::checkpoint_magic;
+
+template <class Bucket>
+constexpr std::uint32_t durable_buckets<Bucket>::checkpoint_version;
+
+} // namespace masutils
+
+#endif // MASUTILS_DURABLE_BUCKETS_H_
@@ -0,0 +1,317 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// frozen_buckets.h - Read-only bucket collection built by buckets::freeze()
+
+#ifndef MASUTILS_FROZEN_BUCKETS_H_
+#define MASUTILS_FROZEN_BUCKETS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // CSTDINT_H_
+
+#ifndef LIMITS_H_
+#include <limits>
+#endif // LIMITS_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+#include "boundary_search.h"
+
+namespace masutils {
+
+// A frozen_buckets is an immutable copy of a buckets which is laid out for
+// queries instead of for edits. The low boundaries are kept in their own
+// contiguous array (searched with boundary_search), the buckets themselves
+// are kept in a contiguous array, and all of the values of all of the buckets
+// are packed into a single pool. Each bucket refers to its values through a
+// value_range, which can be iterated just like a value container.
+//
+// When frozen with boundary_encoding::relative32, a constrained bucket with an
+// integral index (and compare_traits or compare_traits_descending) keeps the
+// searched boundaries as 32 bit offsets from low() instead of full width
+// indices. A day or a month of time_t boundaries fits easily, the search array
+// is half the size, and twice as many boundaries fit in each cache line. If
+// the buckets are not constrained, the index type is not supported or the
+// range does not fit in 32 bits, the full width boundaries are kept instead;
+// encoding() tells which one is in use.
+//
+// A frozen_buckets cannot be copied (the buckets point into the value pool)
+// but it can be moved.
+template <class Indices,
+          class Values,
+          class Traits,
+          class ContainerTraits>
+class frozen_buckets
+{
+public:
+	typedef Indices index_type;
+	typedef Values value_type;
+
+	typedef Traits traits_type;
+	typedef ContainerTraits container_traits;
+
+	typedef buckets<Indices, Values, Traits, ContainerTraits> source_type;
+
+	class value_range
+	{
+	public:
+		typedef const value_type* const_iterator;
+		typedef const_iterator iterator;
+
+		value_range() noexcept : begin_(nullptr), end_(nullptr) {}
+		value_range(const_iterator begin, const_iterator end) noexcept : begin_(begin), end_(end) {}
+
+		const_iterator begin() const noexcept { return begin_; }
+		const_iterator end() const noexcept { return end_; }
+		std::size_t size() const noexcept { return static_cast<std::size_t>(end_ - begin_); }
+		bool empty() const noexcept { return begin_ == end_; }
+		const value_type& front() const { return *begin_; }
+		const value_type& back() const { return *(end_ - 1); }
+
+	private:
+		const_iterator begin_;
+		const_iterator end_;
+	};
+
+	typedef value_range value_container;
+	typedef triplet<index_type,
+	                index_type,
+	                value_range> triplet_type;
+	typedef std::vector<triplet_type> triplet_list;
+
+	typedef typename triplet_list::const_iterator const_iterator;
+	typedef const_iterator iterator;
+	typedef typename triplet_list::const_reverse_iterator const_reverse_iterator;
+	typedef const_reverse_iterator reverse_iterator;
+
+	template <class Stats>
+	explicit frozen_buckets(const buckets<Indices, Values, Traits, ContainerTraits, Stats>& source_,
+		boundary_encoding encoding = boundary_encoding::full)
+		: low_(source_.low()), high_(source_.high()), constrained_(source_.constrained()), encoding_(boundary_encoding::full)
+	{
+		if (encoding == boundary_encoding::relative32 && constrained_ && fits_relative(relative_supported()))
+			encoding_ = boundary_encoding::relative32;
+
+		std::size_t values = 0;
+		for (auto p = source_.begin(); p != source_.end(); ++p)
+			values += static_cast<std::size_t>(std::distance(p->third.begin(), p->third.end()));
+
+		if (encoding_ == boundary_encoding::full)
+			lows_.reserve(source_.size());
+		else
+			offsets_.reserve(source_.size());
+		buckets_.reserve(source_.size());
+		pool_.reserve(values);
+
+		// the pool is filled first, the value_ranges can only be set once
+		// the pool will not move anymore
+		std::vector<std::size_t> offsets;
+		offsets.reserve(source_.size() + 1);
+		for (auto p = source_.begin(); p != source_.end(); ++p)
+		{
+			offsets.push_back(pool_.size());
+			pool_.insert(pool_.end(), p->third.begin(), p->third.end());
+		}
+		offsets.push_back(pool_.size());
+
+		std::size_t i = 0;
+		for (auto p = source_.begin(); p != source_.end(); ++p, ++i)
+		{
+			if (encoding_ == boundary_encoding::full)
+				lows_.push_back(p->first);
+			else
+				offsets_.push_back(offset_of(p->first, relative_supported()));
+			buckets_.push_back(triplet_type(p->first, p->second,
+				value_range(pool_.data() + offsets[i], pool_.data() + offsets[i + 1])));
+		}
+	}
+
+	frozen_buckets(frozen_buckets&&) noexcept = default;
+	frozen_buckets& operator=(frozen_buckets&&) noexcept = default;
+	~frozen_buckets() = default;
+
+	const_iterator begin() const noexcept { return buckets_.begin(); }
+	const_iterator end() const noexcept { return buckets_.end(); }
+	const_reverse_iterator rbegin() const noexcept { return buckets_.rbegin(); }
+	const_reverse_iterator rend() const noexcept { return buckets_.rend(); }
+
+	// Same range API as buckets, but only the const form is available, and
+	// the same buckets as buckets::beginRange/endRange: those which start
+	// before end_range and end at or after start_range, up to (not including)
+	// the bucket which holds end_range, that is which starts before end_range
+	// and ends at or after it.
+	template <bool IsConst = true>
+	const_iterator beginRange(index_type start_range, index_type end_range) const
+	{
+		static_assert(IsConst, "frozen_buckets are read-only");
+		const std::size_t last = range_end(end_range);
+
+		// the buckets before upper_position start at or before start_range;
+		// the ones which end at or after it (at most two, when one ends where
+		// the next starts) are in the range
+		std::size_t first = upper_position(start_range);
+		while (first > 0 && !Traits::lt(buckets_[first - 1].second, start_range))
+			--first;
+		return buckets_.begin() + static_cast<std::ptrdiff_t>(first < last ? first : last);
+	}
+
+	template <bool IsConst = true>
+	const_iterator endRange(index_type /*start_range*/, index_type end_range) const
+	{
+		static_assert(IsConst, "frozen_buckets are read-only");
+		return buckets_.begin() + static_cast<std::ptrdiff_t>(range_end(end_range));
+	}
+
+	template <bool IsConst = true>
+	const_reverse_iterator rbeginRange(index_type start_range, index_type end_range) const
+	{
+		return const_reverse_iterator(endRange<IsConst>(start_range, end_range));
+	}
+
+	template <bool IsConst = true>
+	const_reverse_iterator rendRange(index_type start_range, index_type end_range) const
+	{
+		return const_reverse_iterator(beginRange<IsConst>(start_range, end_range));
+	}
+
+	// Stabbing query: the bucket which contains index, or end().
+	const_iterator find(index_type index) const
+	{
+		const std::size_t i = upper_position(index);
+		if (i == 0 || !Traits::lt(index, buckets_[i - 1].second))
+			return buckets_.end();
+		return buckets_.begin() + static_cast<std::ptrdiff_t>(i - 1);
+	}
+
+	std::size_t size() const noexcept { return buckets_.size(); }
+	bool empty() const noexcept { return buckets_.empty(); }
+	index_type low() const { return low_; }
+	index_type high() const { return high_; }
+	bool constrained() const noexcept { return constrained_; }
+	boundary_encoding encoding() const noexcept { return encoding_; }
+
+private:
+	frozen_buckets(const frozen_buckets&) = delete;
+	frozen_buckets& operator=(const frozen_buckets&) = delete;
+
+	typedef std::integral_constant<bool, is_vectorizable_search<Traits, Indices>::value> relative_supported;
+
+	static constexpr bool descending = std::is_same<Traits, compare_traits_descending<Indices>>::value;
+
+	// the end of a range: the bucket holding end_range when there is one
+	// (it is left out, like buckets::endRange does), otherwise the first
+	// bucket which starts at or after end_range
+	std::size_t range_end(const index_type& end_range) const
+	{
+		const std::size_t last = lower_position(end_range, relative_supported());
+		if (last > 0 && !Traits::lt(buckets_[last - 1].second, end_range))
+			return last - 1;
+		return last;
+	}
+
+	std::size_t upper_position(const index_type& key) const
+	{
+		return upper_position(key, relative_supported());
+	}
+
+	std::size_t upper_position(const index_type& key, std::false_type) const
+	{
+		return search_upper_bound<Traits>(lows_.data(), lows_.size(), key);
+	}
+
+	std::size_t upper_position(const index_type& key, std::true_type) const
+	{
+		if (encoding_ == boundary_encoding::full)
+			return upper_position(key, std::false_type());
+
+		std::uint32_t offset;
+		const int where = relative_offset(key, offset);
+		if (where != 0)
+			return where < 0 ? 0 : offsets_.size();
+		return search_upper_bound<compare_traits<std::uint32_t>>(offsets_.data(), offsets_.size(), offset);
+	}
+
+	std::size_t lower_position(const index_type& key, std::false_type) const
+	{
+		return search_lower_bound<Traits>(lows_.data(), lows_.size(), key);
+	}
+
+	std::size_t lower_position(const index_type& key, std::true_type) const
+	{
+		if (encoding_ == boundary_encoding::full)
+			return lower_position(key, std::false_type());
+
+		std::uint32_t offset;
+		const int where = relative_offset(key, offset);
+		if (where != 0)
+			return where < 0 ? 0 : offsets_.size();
+		return search_lower_bound<compare_traits<std::uint32_t>>(offsets_.data(), offsets_.size(), offset);
+	}
+
+	// distance of index from low_ in the direction of Traits (index must not
+	// be before low_); unsigned arithmetic cannot overflow
+	static unsigned long long distance_from(const index_type& low, const index_type& index)
+	{
+		return descending
+			? static_cast<unsigned long long>(low) - static_cast<unsigned long long>(index)
+			: static_cast<unsigned long long>(index) - static_cast<unsigned long long>(low);
+	}
+
+	bool fits_relative(std::false_type) const { return false; }
+
+	bool fits_relative(std::true_type) const
+	{
+		return distance_from(low_, high_) <= std::numeric_limits<std::uint32_t>::max();
+	}
+
+	std::uint32_t offset_of(const index_type& index, std::true_type) const
+	{
+		return static_cast<std::uint32_t>(distance_from(low_, index));
+	}
+
+	std::uint32_t offset_of(const index_type&, std::false_type) const { return 0; }
+
+	// -1 when key is before low_, 1 when key is past every possible offset,
+	// otherwise 0 with offset set to the offset of key
+	int relative_offset(const index_type& key, std::uint32_t& offset) const
+	{
+		if (Traits::lt(key, low_))
+			return -1;
+		const unsigned long long distance = distance_from(low_, key);
+		if (distance > std::numeric_limits<std::uint32_t>::max())
+			return 1;
+		offset = static_cast<std::uint32_t>(distance);
+		return 0;
+	}
+
+	std::vector<index_type> lows_;
+	std::vector<std::uint32_t> offsets_;
+	triplet_list buckets_;
+	std::vector<value_type> pool_;
+	index_type low_;
+	index_type high_;
+	bool constrained_;
+	boundary_encoding encoding_;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_FROZEN_BUCKETS_H_
@@ -0,0 +1,373 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// numeric_buckets.h - Additive numeric buckets stored as parallel arrays
+
+#ifndef MASUTILS_NUMERIC_BUCKETS_H_
+#define MASUTILS_NUMERIC_BUCKETS_H_
+
+#ifndef CSTDDEF_H_
+#include <cstddef>
+#endif // CSTDDEF_H_
+
+#ifndef ITERATOR_H_
+#include <iterator>
+#endif // ITERATOR_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+#include "boundary_search.h"
+
+namespace masutils {
+
+// A numeric_buckets gives the same results as a buckets whose value container
+// traits are bucket_value_add_traits (every bucket holds a single running
+// sum), but keeps the low boundaries, the high boundaries and the sums of the
+// buckets in three parallel arrays instead of a list of triplets. Adding a
+// value to a run of existing buckets is a single loop over a contiguous slice
+// of the sums, which the compiler vectorizes, and so are the reductions over
+// the whole collection (sum, max_sum, weighted_sum).
+//
+// Like buckets, a spread which reaches into a gap creates a new bucket holding
+// just the spread value, and the sums are accumulated in the same order, so
+// even floating point sums are identical to those of bucket_value_add_traits.
+template <class Indices,
+          class Number,
+          class Traits = compare_traits<Indices>>
+class numeric_buckets
+{
+	static_assert(std::is_arithmetic<Number>::value, "numeric_buckets requires an arithmetic value type");
+
+public:
+	typedef numeric_buckets<Indices,
+	                        Number,
+	                        Traits> mytype;
+
+	typedef Indices index_type;
+	typedef Number value_type;
+
+	typedef Traits traits_type;
+
+	struct bucket_view
+	{
+		index_type first;
+		index_type second;
+		value_type third;
+	};
+
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef bucket_view value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const bucket_view* pointer;
+		typedef bucket_view reference;
+
+		struct arrow_proxy
+		{
+			bucket_view view;
+			const bucket_view* operator->() const noexcept { return &view; }
+		};
+
+		const_iterator(const mytype* owner, std::size_t i) noexcept : owner_(owner), i_(i) {}
+
+		bucket_view operator*() const
+		{
+			return bucket_view{ owner_->lows_[i_], owner_->highs_[i_], owner_->sums_[i_] };
+		}
+
+		arrow_proxy operator->() const { return arrow_proxy{ **this }; }
+
+		const_iterator& operator++() noexcept
+		{
+			++i_;
+			return *this;
+		}
+
+		const_iterator operator++(int) noexcept
+		{
+			const_iterator previous(*this);
+			++i_;
+			return previous;
+		}
+
+		bool operator==(const const_iterator& other) const noexcept { return i_ == other.i_; }
+		bool operator!=(const const_iterator& other) const noexcept { return i_ != other.i_; }
+
+	private:
+		const mytype* owner_;
+		std::size_t i_;
+	};
+
+	typedef const_iterator iterator;
+
+	explicit numeric_buckets(index_type low, index_type high) : low_(low), high_(high), constrained_(true)
+	{
+		if (Traits::lt(high_, low_))
+			throw std::invalid_argument("Arguments not in correct order.");
+	}
+
+	explicit numeric_buckets() noexcept : low_(0), high_(0), constrained_(false)
+	{
+	}
+
+	numeric_buckets(mytype&&) noexcept = default;
+	mytype& operator=(mytype&&) noexcept = default;
+	~numeric_buckets() = default;
+
+	const_iterator begin() const noexcept { return const_iterator(this, 0); }
+	const_iterator end() const noexcept { return const_iterator(this, sums_.size()); }
+
+	// The parallel arrays themselves; bucket i is [lows()[i], highs()[i])
+	// with sum sums()[i].
+	const std::vector<index_type>& lows() const noexcept { return lows_; }
+	const std::vector<index_type>& highs() const noexcept { return highs_; }
+	const std::vector<value_type>& sums() const noexcept { return sums_; }
+
+	// The bucket which contains index, or end().
+	const_iterator find(index_type index) const
+	{
+		const std::size_t i = search_upper_bound<Traits>(lows_.data(), lows_.size(), index);
+		if (i == 0 || !Traits::lt(index, highs_[i - 1]))
+			return end();
+		return const_iterator(this, i - 1);
+	}
+
+	std::size_t size() const noexcept { return sums_.size(); }
+	bool empty() const noexcept { return sums_.empty(); }
+	index_type low() const { return low_; }
+	index_type high() const { return high_; }
+	bool constrained() const noexcept { return constrained_; }
+
+	int spread(index_type low, index_type high, value_type value)
+	{
+		index_type l, h;
+		if (!clamp(low, high, l, h))
+			return 0;
+
+		split(l);
+		split(h);
+
+		const std::size_t first = search_lower_bound<Traits>(lows_.data(), lows_.size(), l);
+		const std::size_t last = search_lower_bound<Traits>(lows_.data(), lows_.size(), h);
+
+		if (contiguous(first, last, l, h))
+		{
+			// the common case: one vectorizable add over the slice
+			value_type* sums = sums_.data();
+			for (std::size_t i = first; i < last; ++i)
+				sums[i] += value;
+			return static_cast<int>(last - first);
+		}
+
+		// some of [l, h) is not covered yet, rebuild the slice with a new
+		// bucket for every gap
+		std::vector<index_type> lows, highs;
+		std::vector<value_type> sums;
+		lows.reserve(2 * (last - first) + 1);
+		highs.reserve(2 * (last - first) + 1);
+		sums.reserve(2 * (last - first) + 1);
+
+		index_type at;
+		Traits::assign(at, l);
+		for (std::size_t i = first; i < last; ++i)
+		{
+			if (Traits::lt(at, lows_[i]))
+			{
+				lows.push_back(at);
+				highs.push_back(lows_[i]);
+				sums.push_back(value);
+			}
+			lows.push_back(lows_[i]);
+			highs.push_back(highs_[i]);
+			sums.push_back(sums_[i] + value);
+			Traits::assign(at, highs_[i]);
+		}
+		if (Traits::lt(at, h))
+		{
+			lows.push_back(at);
+			highs.push_back(h);
+			sums.push_back(value);
+		}
+
+		replace(first, last, lows, highs, sums);
+		return static_cast<int>(sums.size());
+	}
+
+	int cover(index_type low, index_type high, value_type value)
+	{
+		index_type l, h;
+		if (!clamp(low, high, l, h))
+			return 0;
+
+		split(l);
+		split(h);
+
+		const std::size_t first = search_lower_bound<Traits>(lows_.data(), lows_.size(), l);
+		const std::size_t last = search_lower_bound<Traits>(lows_.data(), lows_.size(), h);
+
+		replace(first, last, std::vector<index_type>(1, l), std::vector<index_type>(1, h), std::vector<value_type>(1, value));
+		return 1;
+	}
+
+	// Sum of the sums of all of the buckets.
+	value_type sum() const noexcept
+	{
+		value_type total = value_type();
+		const value_type* sums = sums_.data();
+		for (std::size_t i = 0; i < sums_.size(); ++i)
+			total += sums[i];
+		return total;
+	}
+
+	// Largest sum of any bucket (value_type() when there are no buckets).
+	// Not called max() so that it cannot collide with the max macro of
+	// <windows.h>.
+	value_type max_sum() const noexcept
+	{
+		if (sums_.empty())
+			return value_type();
+
+		value_type largest = sums_[0];
+		const value_type* sums = sums_.data();
+		for (std::size_t i = 1; i < sums_.size(); ++i)
+			largest = sums[i] > largest ? sums[i] : largest;
+		return largest;
+	}
+
+	// Sum of every bucket's sum multiplied by the width of the bucket,
+	// accumulated in Accumulator. Only available for an arithmetic index
+	// type. With the default the products are value_type, which can overflow
+	// (an int sum times a time_t width); pass a wider Accumulator (long long,
+	// double) for those.
+	template <class Accumulator = value_type>
+	Accumulator weighted_sum() const noexcept
+	{
+		Accumulator total = Accumulator();
+		for (std::size_t i = 0; i < sums_.size(); ++i)
+			total += static_cast<Accumulator>(sums_[i]) * width<Accumulator>(i);
+		return total;
+	}
+
+	// weighted_sum() divided by the total width of the buckets, that is the
+	// average over the covered part of the index range (gaps are ignored).
+	// Both the products and the widths are accumulated in Accumulator, not in
+	// value_type, so that neither a wide index type (time_t) overflows nor an
+	// integral value type truncates.
+	template <class Accumulator = double>
+	double weighted_average() const noexcept
+	{
+		Accumulator covered = Accumulator();
+		for (std::size_t i = 0; i < sums_.size(); ++i)
+			covered += width<Accumulator>(i);
+		return covered == Accumulator() ? 0.0 : static_cast<double>(weighted_sum<Accumulator>()) / static_cast<double>(covered);
+	}
+
+private:
+	numeric_buckets(const mytype&) = delete;
+	mytype& operator=(const mytype&) = delete;
+
+	static constexpr bool descending = std::is_same<Traits, compare_traits_descending<Indices>>::value;
+
+	template <class T>
+	T width(std::size_t i) const noexcept
+	{
+		return descending
+			? static_cast<T>(lows_[i] - highs_[i])
+			: static_cast<T>(highs_[i] - lows_[i]);
+	}
+
+	// restrict [low, high) to the constraints; false when nothing is left
+	bool clamp(index_type low, index_type high, index_type& l, index_type& h) const
+	{
+		Traits::assign(l, low);
+		Traits::assign(h, high);
+
+		if (constrained_)
+		{
+			if (Traits::lt(h, low_) || Traits::lt(high_, l))
+				return false;
+			if (Traits::lt(l, low_)) Traits::assign(l, low_);
+			if (Traits::lt(high_, h)) Traits::assign(h, high_);
+		}
+
+		return Traits::lt(l, h);
+	}
+
+	// makes at a bucket boundary when it falls inside of a bucket
+	void split(const index_type& at)
+	{
+		const std::size_t i = search_upper_bound<Traits>(lows_.data(), lows_.size(), at);
+		if (i == 0 || !Traits::lt(lows_[i - 1], at) || !Traits::lt(at, highs_[i - 1]))
+			return;
+
+		lows_.insert(lows_.begin() + static_cast<std::ptrdiff_t>(i), at);
+		highs_.insert(highs_.begin() + static_cast<std::ptrdiff_t>(i), highs_[i - 1]);
+		sums_.insert(sums_.begin() + static_cast<std::ptrdiff_t>(i), sums_[i - 1]);
+		Traits::assign(highs_[i - 1], at);
+	}
+
+	// true when buckets [first, last) cover [l, h) without any gap
+	bool contiguous(std::size_t first, std::size_t last, const index_type& l, const index_type& h) const
+	{
+		if (first == last || !Traits::eq(lows_[first], l) || !Traits::eq(highs_[last - 1], h))
+			return false;
+		for (std::size_t i = first + 1; i < last; ++i)
+			if (!Traits::eq(highs_[i - 1], lows_[i]))
+				return false;
+		return true;
+	}
+
+	// replaces buckets [first, last) with the given buckets
+	void replace(std::size_t first, std::size_t last,
+		const std::vector<index_type>& lows, const std::vector<index_type>& highs, const std::vector<value_type>& sums)
+	{
+		replace(lows_, first, last, lows);
+		replace(highs_, first, last, highs);
+		replace(sums_, first, last, sums);
+	}
+
+	template <class T>
+	static void replace(std::vector<T>& x, std::size_t first, std::size_t last, const std::vector<T>& y)
+	{
+		const std::size_t common = (last - first) < y.size() ? (last - first) : y.size();
+		std::copy(y.begin(), y.begin() + static_cast<std::ptrdiff_t>(common), x.begin() + static_cast<std::ptrdiff_t>(first));
+		if (common < y.size())
+			x.insert(x.begin() + static_cast<std::ptrdiff_t>(first + common), y.begin() + static_cast<std::ptrdiff_t>(common), y.end());
+		else
+			x.erase(x.begin() + static_cast<std::ptrdiff_t>(first + common), x.begin() + static_cast<std::ptrdiff_t>(last));
+	}
+
+	std::vector<index_type> lows_;
+	std::vector<index_type> highs_;
+	std::vector<value_type> sums_;
+	index_type low_;
+	index_type high_;
+	bool constrained_;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_NUMERIC_BUCKETS_H_
@@ -0,0 +1,294 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// recurring_buckets.h - Buckets with compact, lazily expanded recurring edits
+
+#ifndef MASUTILS_RECURRING_BUCKETS_H_
+#define MASUTILS_RECURRING_BUCKETS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDDEF_H_
+#include <cstddef>
+#endif // CSTDDEF_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef UTILITY_H_
+#include <utility>
+#endif // UTILITY_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+// recurring_buckets is a buckets which also accepts recurring edits, e.g. an
+// "Open" window from 9 to 17 every day, or a weekly roster for a year:
+//
+//     spread_recurring(first_low, first_high, period, count, value)
+//
+// stands for count spreads of [first_low + i * period, first_high + i * period)
+// for i in [0, count). Such an edit is kept as a rule of constant size and its
+// occurrences are only applied to the buckets when something touches them: a
+// plain spread or cover over them, or view(low, high) before reading a range.
+//
+// The result is always exactly the same as if every occurrence had been
+// applied when the rule was added. Occurrences only interact with edits that
+// overlap them, so before an edit (or a view) of [low, high) every pending
+// occurrence overlapping the range is applied, in the order the rules were
+// added; the range is first grown to take in any pending occurrence which
+// overlaps one of those.
+//
+// Requires an arithmetic index in ascending order (compare_traits).
+template <class Indices,
+          class Values,
+          class Traits = compare_traits<Indices>,
+          class ContainerTraits = bucket_value_traits<Values>>
+class recurring_buckets
+{
+public:
+	typedef buckets<Indices, Values, Traits, ContainerTraits> bucket_type;
+
+	typedef Indices index_type;
+	typedef Values value_type;
+	typedef typename bucket_type::triplet_type triplet_type;
+
+	static_assert(std::is_arithmetic<index_type>::value, "recurring_buckets requires an arithmetic index type");
+	static_assert(std::is_same<Traits, compare_traits<index_type>>::value,
+		"recurring_buckets requires ascending compare_traits");
+
+	explicit recurring_buckets(index_type low, index_type high) : bucket_(low, high) {}
+	explicit recurring_buckets() {}
+
+	int spread(index_type low, index_type high, value_type value)
+	{
+		materialize(low, high);
+		return bucket_.spread(low, high, value);
+	}
+
+	int cover(index_type low, index_type high, value_type value)
+	{
+		materialize(low, high);
+		return bucket_.cover(low, high, value);
+	}
+
+	void spread_recurring(index_type first_low, index_type first_high, index_type period, std::size_t count, value_type value)
+	{
+		add_rule(kind::spread, first_low, first_high, period, count, value);
+	}
+
+	// count covers of [first_low + i * period, first_high + i * period); like
+	// repeated calls to cover, a later occurrence replaces an earlier one it
+	// overlaps
+	void cover_recurring(index_type first_low, index_type first_high, index_type period, std::size_t count, value_type value)
+	{
+		add_rule(kind::cover, first_low, first_high, period, count, value);
+	}
+
+	// The buckets, exact within [low, high) (outside of it occurrences of
+	// recurring edits may still be missing).
+	const bucket_type& view(index_type low, index_type high)
+	{
+		materialize(low, high);
+		return bucket_;
+	}
+
+	// The buckets with every recurring edit applied.
+	const bucket_type& view()
+	{
+		for (auto& r : rules_)
+		{
+			for (const auto& range : r.pending)
+				apply(r, range.first, range.second);
+		}
+		rules_.clear();
+		return bucket_;
+	}
+
+	// number of recurring edits with occurrences still to be applied
+	std::size_t rule_count() const noexcept { return rules_.size(); }
+
+	// number of occurrences still to be applied
+	std::size_t pending() const noexcept
+	{
+		std::size_t total = 0;
+		for (const auto& r : rules_)
+		{
+			for (const auto& range : r.pending)
+				total += range.second - range.first;
+		}
+		return total;
+	}
+
+private:
+	recurring_buckets(const recurring_buckets&) = delete;
+	recurring_buckets& operator=(const recurring_buckets&) = delete;
+
+	enum class kind { spread, cover };
+
+	// [begin, end) of the occurrence numbers of a rule
+	typedef std::pair<std::size_t, std::size_t> occurrence_range;
+
+	struct rule
+	{
+		kind what;
+		index_type first_low;
+		index_type first_high;
+		index_type period;
+		std::size_t count;
+		value_type value;
+		std::vector<occurrence_range> pending; // sorted, not yet applied
+	};
+
+	void add_rule(kind what, index_type first_low, index_type first_high, index_type period, std::size_t count, value_type value)
+	{
+		if (!(index_type() < period))
+			throw std::invalid_argument("Period must be positive.");
+		if (Traits::lt(first_high, first_low))
+			throw std::invalid_argument("Arguments not in correct order.");
+		if (count == 0 || !Traits::lt(first_low, first_high))
+			return;
+
+		rules_.push_back(rule{ what, first_low, first_high, period, count, value,
+			std::vector<occurrence_range>(1, occurrence_range(0, count)) });
+	}
+
+	static index_type low_of(const rule& r, std::size_t i)
+	{
+		return r.first_low + static_cast<index_type>(i) * r.period;
+	}
+
+	static index_type high_of(const rule& r, std::size_t i)
+	{
+		return r.first_high + static_cast<index_type>(i) * r.period;
+	}
+
+	// an estimate of an occurrence number, limited to [0, count]
+	static std::size_t clamp(const index_type& estimate, std::size_t count)
+	{
+		if (estimate < index_type())
+			return 0;
+		if (!(estimate < static_cast<index_type>(count)))
+			return count;
+		return static_cast<std::size_t>(estimate);
+	}
+
+	// the occurrences [begin, end) of a rule which overlap [low, high)
+	static occurrence_range overlapping(const rule& r, const index_type& low, const index_type& high)
+	{
+		// the first one which ends after low...
+		std::size_t begin = clamp((low - r.first_high) / r.period, r.count);
+		while (begin > 0 && low < high_of(r, begin - 1))
+			--begin;
+		while (begin < r.count && !(low < high_of(r, begin)))
+			++begin;
+
+		// ...up to the first one which starts at or after high
+		std::size_t end = clamp((high - r.first_low) / r.period, r.count);
+		if (end < begin)
+			end = begin;
+		while (end > begin && !(low_of(r, end - 1) < high))
+			--end;
+		while (end < r.count && low_of(r, end) < high)
+			++end;
+
+		return occurrence_range(begin, end);
+	}
+
+	void apply(const rule& r, std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			if (r.what == kind::spread)
+				bucket_.spread(low_of(r, i), high_of(r, i), r.value);
+			else
+				bucket_.cover(low_of(r, i), high_of(r, i), r.value);
+		}
+	}
+
+	void materialize(index_type low, index_type high)
+	{
+		if (rules_.empty() || !Traits::lt(low, high))
+			return;
+
+		// grow [low, high) until it holds every pending occurrence which
+		// overlaps it; what is left outside then commutes with everything
+		// applied below
+		for (bool grown = true; grown; )
+		{
+			grown = false;
+			for (const auto& r : rules_)
+			{
+				const occurrence_range touched = overlapping(r, low, high);
+				for (const auto& range : r.pending)
+				{
+					const std::size_t first = range.first < touched.first ? touched.first : range.first;
+					const std::size_t last = touched.second < range.second ? touched.second : range.second;
+					if (last <= first)
+						continue;
+
+					if (low_of(r, first) < low) { low = low_of(r, first); grown = true; }
+					if (high < high_of(r, last - 1)) { high = high_of(r, last - 1); grown = true; }
+				}
+			}
+		}
+
+		// apply them in the order the rules were added
+		for (auto r = rules_.begin(); r != rules_.end(); )
+		{
+			const occurrence_range touched = overlapping(*r, low, high);
+
+			std::vector<occurrence_range> kept;
+			for (const auto& range : r->pending)
+			{
+				const std::size_t first = range.first < touched.first ? touched.first : range.first;
+				const std::size_t last = touched.second < range.second ? touched.second : range.second;
+				if (last <= first)
+				{
+					kept.push_back(range);
+					continue;
+				}
+
+				apply(*r, first, last);
+				if (range.first < first)
+					kept.push_back(occurrence_range(range.first, first));
+				if (last < range.second)
+					kept.push_back(occurrence_range(last, range.second));
+			}
+			r->pending.swap(kept);
+
+			if (r->pending.empty())
+				r = rules_.erase(r);
+			else
+				++r;
+		}
+	}
+
+	bucket_type bucket_;
+	std::vector<rule> rules_; // in the order they were added
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_RECURRING_BUCKETS_H_
@@ -0,0 +1,374 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// rollup_pyramid.h - Multi-resolution numeric rollups of a buckets
+
+#ifndef MASUTILS_ROLLUP_PYRAMID_H_
+#define MASUTILS_ROLLUP_PYRAMID_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef ITERATOR_H_
+#include <iterator>
+#endif // ITERATOR_H_
+
+#ifndef MAP_H_
+#include <map>
+#endif // MAP_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef UTILITY_H_
+#include <utility>
+#endif // UTILITY_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+template <class E, class C>
+struct bucket_value_add_traits;
+
+// A rollup_pyramid keeps coarser views of a buckets of numbers up to date
+// as it changes, e.g. hourly, daily and weekly bins of a time_t timeline.
+// The amount of a bucket is the sum of the values in its container (with
+// bucket_value_add_traits, its running sum), and each bin holds the integral
+// of the amounts over the bin: every bucket contributes its amount times the
+// length of its overlap with the bin.
+//
+// The pyramid attaches itself as the observer of the buckets, which must not
+// have one yet. With bucket_value_traits (whose containers only ever grow by
+// the values spread) and bucket_value_add_traits (whose running sum grows by
+// their sum), a spread adds to the bins it touches on every level. With any
+// other container traits (unique, most recent, ...) the amount of a bucket
+// after a spread cannot be told from the values spread, so the bins under
+// its range are recomputed from the buckets, as they are after a cover, and
+// so are the bins under the range a rolled back batch changed.
+//
+// Like a cursor, the pyramid remembers the bucket it last looked at and
+// walks the buckets from there (in either direction) to the ones it needs,
+// so recomputing or integrating near the previous edit does not scan from
+// the first bucket. Because of that even the const queries must not run
+// concurrently.
+//
+// integral() answers from the coarsest bins which fit inside the range, and
+// only descends to finer levels (and finally the buckets themselves) at the
+// edges; a range aligned to the finest level never scans the buckets.
+// series() returns the bins of one resolution for rendering.
+//
+// The widths must be increasing and each a multiple of the one before, and
+// the index must be an arithmetic type ordered by compare_traits.
+template <class Bucket, class Number = double>
+class rollup_pyramid : public buckets_observer<typename Bucket::index_type, typename Bucket::value_container>
+{
+public:
+	typedef Bucket bucket_type;
+	typedef typename Bucket::index_type index_type;
+	typedef typename Bucket::value_container value_container;
+	typedef Number number_type;
+
+	typedef long long key_type;
+	typedef std::map<key_type, number_type> level_type;
+
+	static_assert(std::is_arithmetic<index_type>::value, "rollup_pyramid requires an arithmetic index type");
+	static_assert(std::is_same<typename Bucket::traits_type, compare_traits<index_type>>::value,
+		"rollup_pyramid requires compare_traits");
+
+	rollup_pyramid(bucket_type& bucket, index_type origin, const std::vector<index_type>& widths)
+		: bucket_(&bucket), origin_(origin), widths_(widths), levels_(widths.size()), finger_(bucket.end()), finger_first_(), finger_second_()
+	{
+		if (bucket_->observer() != nullptr)
+			throw std::logic_error("The buckets already have an observer.");
+		if (widths_.empty())
+			throw std::invalid_argument("A rollup needs at least one level.");
+		for (std::size_t i = 0; i < widths_.size(); ++i)
+		{
+			if (!(index_type() < widths_[i]) ||
+			    (i > 0 && (!(widths_[i - 1] < widths_[i]) || !multiple(widths_[i], widths_[i - 1]))))
+				throw std::invalid_argument("Rollup widths must be increasing multiples of each other.");
+		}
+
+		rebuild();
+		bucket_->observe(this);
+	}
+
+	rollup_pyramid(const rollup_pyramid&) = delete;
+	rollup_pyramid& operator=(const rollup_pyramid&) = delete;
+
+	~rollup_pyramid()
+	{
+		if (bucket_->observer() == this)
+			bucket_->observe(nullptr);
+	}
+
+	std::size_t levels() const noexcept { return widths_.size(); }
+	index_type width(std::size_t level) const { return widths_[level]; }
+
+	// the non empty bins of a level by bin number (bin k starts at
+	// origin + k * width)
+	const level_type& level(std::size_t level) const { return levels_[level]; }
+
+	// Integral of the amounts over [low, high).
+	number_type integral(index_type low, index_type high) const
+	{
+		return integral(low, high, static_cast<int>(widths_.size()) - 1);
+	}
+
+	// The bins of the coarsest level no wider than resolution (the finest
+	// level when all are wider) which overlap [low, high), as (bin start,
+	// integral) pairs. Empty bins are left out.
+	void series(index_type low, index_type high, index_type resolution,
+		std::vector<std::pair<index_type, number_type>>& out) const
+	{
+		std::size_t level = 0;
+		while (level + 1 < widths_.size() && !(resolution < widths_[level + 1]))
+			++level;
+
+		out.clear();
+		const level_type& bins = levels_[level];
+		for (auto p = bins.lower_bound(key_of(level, low)); p != bins.end() && bin_low(level, p->first) < high; ++p)
+			out.push_back(std::make_pair(bin_low(level, p->first), p->second));
+	}
+
+	// buckets_observer
+	void appended(const index_type& low, const index_type& high, const value_container& values) override
+	{
+		appended(low, high, values, appends_values<typename Bucket::container_traits>());
+	}
+
+	void covered(const index_type& low, const index_type& high, const value_container&) override
+	{
+		// the covered buckets are gone, the finger may have been one of them
+		if (finger_ != bucket_->end() && finger_first_ < high && low < finger_second_)
+			finger_ = bucket_->end();
+		recompute_range(low, high);
+	}
+
+	void rolled_back(const index_type& low, const index_type& high) override
+	{
+		finger_ = bucket_->end();
+		if (low < high)
+			recompute_range(low, high);
+	}
+
+private:
+	// true when appending values to a container adds exactly their amount
+	template <class ContainerTraits>
+	struct appends_values : std::false_type {};
+
+	template <class E, class C>
+	struct appends_values<bucket_value_traits<E, C>> : std::true_type {};
+
+	template <class E, class C>
+	struct appends_values<bucket_value_add_traits<E, C>> : std::true_type {};
+
+	typedef typename Bucket::const_iterator const_iterator;
+
+	// The first bucket which ends after low (end() when there is none),
+	// walked to from the finger, which is then moved there. Buckets are only
+	// erased by a cover or a rollback, which move the finger off them (the
+	// range kept with the finger is only ever wider than its bucket, since
+	// buckets are split, never grown, so the check errs on the safe side).
+	const_iterator seek(const index_type& low) const
+	{
+		const bucket_type& bucket = *bucket_;
+		const_iterator p = finger_;
+		while (p != bucket.begin())
+		{
+			const_iterator previous = std::prev(p);
+			if (!(low < previous->second))
+				break;
+			p = previous;
+		}
+		while (p != bucket.end() && !(low < p->second))
+			++p;
+
+		finger_ = p;
+		if (p != bucket.end())
+		{
+			finger_first_ = p->first;
+			finger_second_ = p->second;
+		}
+		return p;
+	}
+
+	void appended(const index_type& low, const index_type& high, const value_container& values, std::true_type)
+	{
+		const number_type amount = amount_of(values);
+		for (std::size_t level = 0; level < widths_.size(); ++level)
+			add(level, low, high, amount);
+	}
+
+	void appended(const index_type& low, const index_type& high, const value_container&, std::false_type)
+	{
+		recompute_range(low, high);
+	}
+
+	// recomputes the bins under [low, high) at the coarsest level, which
+	// include the finer ones
+	void recompute_range(const index_type& low, const index_type& high)
+	{
+		const std::size_t top = widths_.size() - 1;
+		recompute(bin_low(top, key_of(top, low)), bin_low(top, last_key(top, high) + 1));
+	}
+
+	static bool multiple(const index_type& x, const index_type& y)
+	{
+		const index_type n = static_cast<index_type>(static_cast<key_type>(x / y));
+		return n * y == x;
+	}
+
+	key_type key_of(std::size_t level, const index_type& index) const
+	{
+		const index_type offset = index - origin_;
+		key_type key = static_cast<key_type>(offset / widths_[level]);
+		if (offset < static_cast<index_type>(key) * widths_[level])
+			--key; // round towards minus infinity
+		return key;
+	}
+
+	// the bin holding the last index before high
+	key_type last_key(std::size_t level, const index_type& high) const
+	{
+		const key_type key = key_of(level, high);
+		return bin_low(level, key) < high ? key : key - 1;
+	}
+
+	index_type bin_low(std::size_t level, key_type key) const
+	{
+		return origin_ + static_cast<index_type>(key) * widths_[level];
+	}
+
+	static number_type amount_of(const value_container& values)
+	{
+		number_type amount = number_type();
+		for (auto v = values.begin(); v != values.end(); ++v)
+			amount += static_cast<number_type>(*v);
+		return amount;
+	}
+
+	// adds amount over [low, high) to the bins of a level
+	void add(std::size_t level, const index_type& low, const index_type& high, const number_type& amount)
+	{
+		if (!(low < high))
+			return;
+
+		level_type& bins = levels_[level];
+		for (key_type key = key_of(level, low), last = last_key(level, high); key <= last; ++key)
+		{
+			const index_type bin_l = bin_low(level, key);
+			const index_type bin_h = bin_low(level, key + 1);
+			const index_type l = low < bin_l ? bin_l : low;
+			const index_type h = bin_h < high ? bin_h : high;
+			bins[key] += amount * static_cast<number_type>(h - l);
+		}
+	}
+
+	// recomputes every level over [low, high), which must be aligned to the
+	// bins of the coarsest level
+	void recompute(const index_type& low, const index_type& high)
+	{
+		for (std::size_t level = 0; level < widths_.size(); ++level)
+		{
+			level_type& bins = levels_[level];
+			bins.erase(bins.lower_bound(key_of(level, low)), bins.lower_bound(key_of(level, high)));
+		}
+
+		const bucket_type& bucket = *bucket_;
+		for (auto p = seek(low); p != bucket.end() && p->first < high; ++p)
+		{
+			const index_type l = p->first < low ? low : p->first;
+			const index_type h = high < p->second ? high : p->second;
+			const number_type amount = amount_of(p->third);
+			for (std::size_t level = 0; level < widths_.size(); ++level)
+				add(level, l, h, amount);
+		}
+	}
+
+	void rebuild()
+	{
+		for (auto& bins : levels_)
+			bins.clear();
+
+		const bucket_type& bucket = *bucket_;
+		for (auto p = bucket.begin(); p != bucket.end(); ++p)
+		{
+			const number_type amount = amount_of(p->third);
+			for (std::size_t level = 0; level < widths_.size(); ++level)
+				add(level, p->first, p->second, amount);
+		}
+	}
+
+	number_type integral(const index_type& low, const index_type& high, int level) const
+	{
+		if (!(low < high))
+			return number_type();
+
+		if (level < 0)
+		{
+			// below the finest level: straight from the buckets
+			number_type total = number_type();
+			const bucket_type& bucket = *bucket_;
+			for (auto p = seek(low); p != bucket.end() && p->first < high; ++p)
+			{
+				const index_type l = p->first < low ? low : p->first;
+				const index_type h = high < p->second ? high : p->second;
+				total += amount_of(p->third) * static_cast<number_type>(h - l);
+			}
+			return total;
+		}
+
+		const std::size_t at = static_cast<std::size_t>(level);
+
+		// the whole bins inside [low, high) are [first, last)
+		key_type first = key_of(at, low);
+		if (bin_low(at, first) < low)
+			++first;
+		const key_type last = key_of(at, high);
+		if (last <= first)
+			return integral(low, high, level - 1);
+
+		number_type total = number_type();
+		const level_type& bins = levels_[at];
+		for (auto p = bins.lower_bound(first); p != bins.end() && p->first < last; ++p)
+			total += p->second;
+
+		return total + integral(low, bin_low(at, first), level - 1) + integral(bin_low(at, last), high, level - 1);
+	}
+
+	bucket_type* bucket_;
+	index_type origin_;
+	std::vector<index_type> widths_;
+	std::vector<level_type> levels_;
+
+	// a bucket near the last one looked at (or end()) and its range when it
+	// was last seen
+	mutable const_iterator finger_;
+	mutable index_type finger_first_;
+	mutable index_type finger_second_;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_ROLLUP_PYRAMID_H_
@@ -0,0 +1,729 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// segmented_buckets.h - Bucket collection partitioned into fixed width segments
+
+#ifndef MASUTILS_SEGMENTED_BUCKETS_H_
+#define MASUTILS_SEGMENTED_BUCKETS_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CONDITION_VARIABLE_H_
+#include <condition_variable>
+#endif // CONDITION_VARIABLE_H_
+
+#ifndef CSTDIO_H_
+#include <cstdio>
+#endif // CSTDIO_H_
+
+#ifndef EXCEPTION_H_
+#include <exception>
+#endif // EXCEPTION_H_
+
+#ifndef FSTREAM_H_
+#include <fstream>
+#endif // FSTREAM_H_
+
+#ifndef ITERATOR_H_
+#include <iterator>
+#endif // ITERATOR_H_
+
+#ifndef LIST_H_
+#include <list>
+#endif // LIST_H_
+
+#ifndef MAP_H_
+#include <map>
+#endif // MAP_H_
+
+#ifndef MEMORY_H_
+#include <memory>
+#endif // MEMORY_H_
+
+#ifndef MUTEX_H_
+#include <mutex>
+#endif // MUTEX_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef STRING_H_
+#include <string>
+#endif // STRING_H_
+
+#ifndef TYPE_TRAITS_H_
+#include <type_traits>
+#endif // TYPE_TRAITS_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+#include "bucket_codec.h"
+
+namespace masutils {
+
+// A segmented_buckets partitions the index axis into segments of a fixed
+// width (say one day of time_t) starting at an origin. Each segment is an
+// independent buckets constrained to its segment, with its own mutex, and is
+// only created once something is spread or covered into it. A range which
+// crosses segment boundaries is split at the boundaries, so a bucket never
+// crosses a boundary either.
+//
+// Writers to different segments never wait for each other; the map of
+// segments has its own mutex which is only held to look up, create or remove
+// a segment. A whole segment can be dropped or detached (for archiving)
+// without touching any other segment.
+//
+// Segments can also be tiered (see spill_to): only a bounded number of the
+// most recently used segments are kept in memory, the others are written to
+// segment files and read back as soon as anything touches them again. The
+// files are written and read without the map lock held: a segment on its way
+// to or from its file is marked as moving, and only threads which need that
+// very segment wait for it.
+//
+// Only ascending (compare_traits) arithmetic indices are supported.
+template <class Indices,
+          class Values,
+          class Traits = compare_traits<Indices>,
+          class ContainerTraits = bucket_value_traits<Values>>
+class segmented_buckets
+{
+	static_assert(std::is_arithmetic<Indices>::value, "segmented_buckets requires an arithmetic index type");
+	static_assert(std::is_same<Traits, compare_traits<Indices>>::value, "segmented_buckets requires compare_traits");
+
+public:
+	typedef segmented_buckets<Indices,
+	                          Values,
+	                          Traits,
+	                          ContainerTraits> mytype;
+
+	typedef Indices index_type;
+	typedef Values value_type;
+
+	typedef Traits traits_type;
+	typedef ContainerTraits container_traits;
+
+	typedef buckets<Indices, Values, Traits, ContainerTraits> bucket_type;
+	typedef typename bucket_type::triplet_type triplet_type;
+
+	// segment number: the segment starting at origin + key * width
+	typedef long long key_type;
+
+	// One segment: lock mutex before using bucket.
+	struct segment
+	{
+		segment(index_type low, index_type high) : bucket(low, high) {}
+
+		std::mutex mutex;
+		bucket_type bucket;
+	};
+
+	typedef std::shared_ptr<segment> segment_ptr;
+
+	explicit segmented_buckets(index_type width, index_type origin = index_type()) : width_(width), origin_(origin)
+	{
+		if (!(index_type() < width_))
+			throw std::invalid_argument("Segment width must be positive.");
+	}
+
+	segmented_buckets(const mytype&) = delete;
+	mytype& operator=(const mytype&) = delete;
+
+	// segment files are only a cache of this object
+	~segmented_buckets()
+	{
+		for (auto p = segments_.begin(); p != segments_.end(); ++p)
+			if (!p->second.resident)
+				std::remove(p->second.path.c_str());
+	}
+
+	// Keeps at most max_resident segments in memory. When more are in use,
+	// the least recently used ones are written to a file in directory (which
+	// must exist) and dropped from memory; the next spread, cover or query
+	// which touches a spilled segment reads it back. A segment in use by
+	// another thread is never spilled, so a single call which touches many
+	// segments can briefly exceed the budget. A budget of 0 stops spilling.
+	// Segments spilled before a change of directory stay (and are read back
+	// from) where they were written.
+	//
+	// Segment files hold the boundaries as varint encoded distances from
+	// the previous boundary (for integral indices) and the values of each
+	// bucket encoded with bucket_codec.
+	//
+	// Spilling never makes a spread or cover fail: a segment which cannot be
+	// written stays in memory (over the budget) and the failure is kept for
+	// spill_error(). spill_to() itself throws it. Reading a spilled segment
+	// back can fail too (a missing or corrupt file), and then the spread,
+	// cover or query which needed it throws std::runtime_error, before
+	// changing anything.
+	void spill_to(const std::string& directory, std::size_t max_resident)
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		directory_ = directory;
+		max_resident_ = max_resident;
+		spill_error_ = nullptr;
+		trim(lock);
+		if (spill_error_)
+			std::rethrow_exception(spill_error_);
+	}
+
+	// the last failure to write a segment file since spill_to(), or nullptr
+	std::exception_ptr spill_error() const
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		return spill_error_;
+	}
+
+	// number of segments currently held in memory
+	std::size_t resident_count() const
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		return recent_.size();
+	}
+
+	int spread(index_type low, index_type high, value_type value)
+	{
+		return apply(low, high, [&value](bucket_type& bucket, const index_type& l, const index_type& h) {
+			return bucket.spread(l, h, value);
+		});
+	}
+
+	int cover(index_type low, index_type high, value_type value)
+	{
+		return apply(low, high, [&value](bucket_type& bucket, const index_type& l, const index_type& h) {
+			return bucket.cover(l, h, value);
+		});
+	}
+
+	// Calls f(triplet) for every bucket which overlaps [low, high), in
+	// order, while holding the lock of the bucket's segment.
+	template <class F>
+	void visit(index_type low, index_type high, F f) const
+	{
+		if (!Traits::lt(low, high))
+			return;
+
+		// one segment at a time, so that a tiered collection never needs
+		// more than one extra segment in memory
+		const key_type last = last_key(high);
+		key_type key = key_of(low);
+		for (segment_ptr s = next_segment(key, last); s; s = next_segment(++key, last))
+		{
+			std::lock_guard<std::mutex> lock(s->mutex);
+			for (auto p = s->bucket.begin(); p != s->bucket.end(); ++p)
+				if (Traits::lt(p->first, high) && Traits::lt(low, p->second))
+					f(*p);
+		}
+	}
+
+	// Calls f(triplet) for the bucket which contains index, if there is one,
+	// while holding the lock of its segment.
+	template <class F>
+	bool find(index_type index, F f) const
+	{
+		const segment_ptr s = lookup(key_of(index));
+		if (!s)
+			return false;
+
+		std::lock_guard<std::mutex> lock(s->mutex);
+		const bucket_type& bucket = s->bucket;
+		auto p = bucket.find(index);
+		if (p == bucket.end())
+			return false;
+		f(*p);
+		return true;
+	}
+
+	// Removes the segment containing index; false if there is none.
+	bool drop(index_type index)
+	{
+		return detach(index) != nullptr;
+	}
+
+	// Removes every segment which ends at or before index (retention).
+	// Returns the number of segments removed.
+	std::size_t drop_before(index_type index)
+	{
+		std::vector<segment_ptr> dropped;
+		std::vector<std::string> files;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			auto last = segments_.upper_bound(key_of(index) - 1);
+			for (auto p = segments_.begin(); p != last; )
+			{
+				if (p->second.moving)
+				{
+					// wait for it to settle, then start over
+					moved_.wait(lock);
+					last = segments_.upper_bound(key_of(index) - 1);
+					p = segments_.begin();
+					continue;
+				}
+				++p;
+			}
+			for (auto p = segments_.begin(); p != last; ++p)
+			{
+				dropped.push_back(p->second.resident);
+				forget(p->second, files);
+			}
+			segments_.erase(segments_.begin(), last);
+		}
+		// the segments are destroyed (and their files removed) here, outside
+		// of the lock (or later by whoever still uses them)
+		remove_files(files);
+		return dropped.size();
+	}
+
+	// Removes the segment containing index and hands it over, e.g. to be
+	// archived; nullptr if there is none.
+	segment_ptr detach(index_type index)
+	{
+		segment_ptr s;
+		std::vector<std::string> files;
+		{
+			std::unique_lock<std::mutex> lock(mtx_);
+			auto p = settled(lock, key_of(index));
+			if (p == segments_.end())
+				return segment_ptr();
+			s = resident(lock, p);
+			forget(p->second, files);
+			segments_.erase(p);
+		}
+		remove_files(files);
+		return s;
+	}
+
+	// The segment containing index, or nullptr.
+	segment_ptr at(index_type index) const
+	{
+		return lookup(key_of(index));
+	}
+
+	// Total number of buckets in all of the segments.
+	std::size_t size() const
+	{
+		std::size_t count = 0;
+		std::vector<segment_ptr> resident;
+		{
+			// spilled segments are counted without reading them back
+			std::lock_guard<std::mutex> lock(mtx_);
+			for (auto p = segments_.begin(); p != segments_.end(); ++p)
+			{
+				if (p->second.resident)
+					resident.push_back(p->second.resident);
+				else
+					count += p->second.spilled_size;
+			}
+		}
+		for (const segment_ptr& s : resident)
+		{
+			std::lock_guard<std::mutex> lock(s->mutex);
+			count += s->bucket.size();
+		}
+		return count;
+	}
+
+	std::size_t segment_count() const
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		return segments_.size();
+	}
+
+	index_type width() const { return width_; }
+	index_type origin() const { return origin_; }
+
+	key_type key_of(const index_type& index) const
+	{
+		const index_type offset = index - origin_;
+		key_type key = static_cast<key_type>(offset / width_);
+		if (offset < static_cast<index_type>(key) * width_)
+			--key; // round towards minus infinity
+		return key;
+	}
+
+	index_type segment_low(key_type key) const { return origin_ + static_cast<index_type>(key) * width_; }
+	index_type segment_high(key_type key) const { return segment_low(key + 1); }
+
+private:
+	// the key of the segment holding the last index before high
+	key_type last_key(const index_type& high) const
+	{
+		const key_type key = key_of(high);
+		return Traits::lt(segment_low(key), high) ? key : key - 1;
+	}
+
+	// applies op to the part of [low, high) in each segment it touches
+	template <class Op>
+	int apply(index_type low, index_type high, Op op)
+	{
+		if (!Traits::lt(low, high))
+			return 0;
+
+		int added_to_bucket = 0;
+		for (const segment_ptr& s : acquire(key_of(low), last_key(high)))
+		{
+			std::lock_guard<std::mutex> lock(s->mutex);
+			bucket_type& bucket = s->bucket;
+			const index_type l = Traits::lt(low, bucket.low()) ? bucket.low() : low;
+			const index_type h = Traits::lt(bucket.high(), high) ? bucket.high() : high;
+			added_to_bucket += op(bucket, l, h);
+		}
+
+		{
+			// the segments are no longer in use
+			std::unique_lock<std::mutex> lock(mtx_);
+			trim(lock);
+		}
+		return added_to_bucket;
+	}
+
+	// The segments first through last, creating the missing ones. Like the
+	// other lookups, the segments are taken under the map lock and used after
+	// it is released.
+	std::vector<segment_ptr> acquire(key_type first, key_type last)
+	{
+		std::vector<segment_ptr> result;
+		std::unique_lock<std::mutex> lock(mtx_);
+		for (key_type key = first; key <= last; ++key)
+		{
+			auto p = settled(lock, key);
+			if (p == segments_.end())
+			{
+				p = segments_.insert(std::make_pair(key, slot())).first;
+				p->second.resident = std::make_shared<segment>(segment_low(key), segment_high(key));
+				recent_.push_front(key);
+				p->second.recent = recent_.begin();
+				result.push_back(p->second.resident);
+			}
+			else
+				result.push_back(resident(lock, p));
+		}
+		trim(lock);
+		return result;
+	}
+
+	// the first existing segment from key through last (key is set to its
+	// key), or nullptr
+	segment_ptr next_segment(key_type& key, key_type last) const
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		trim(lock);
+		for (;;)
+		{
+			auto p = segments_.lower_bound(key);
+			if (p == segments_.end() || last < p->first)
+				return segment_ptr();
+			if (p->second.moving)
+			{
+				moved_.wait(lock);
+				continue;
+			}
+			key = p->first;
+			return resident(lock, p);
+		}
+	}
+
+	segment_ptr lookup(key_type key) const
+	{
+		std::unique_lock<std::mutex> lock(mtx_);
+		auto p = settled(lock, key);
+		if (p == segments_.end())
+			return segment_ptr();
+		segment_ptr s = resident(lock, p);
+		trim(lock);
+		return s;
+	}
+
+	// A segment is either resident (in memory and in recent_), spilled (in
+	// its segment file, at path) or moving from one to the other. A moving
+	// slot is neither used nor erased until it settles.
+	struct slot
+	{
+		segment_ptr resident;
+		std::size_t spilled_size = 0;
+		std::string path;
+		typename std::list<key_type>::iterator recent;
+		bool moving = false;
+	};
+
+	typedef typename std::map<key_type, slot>::iterator slot_iterator;
+
+	// The functions below are called with lock (on mtx_) held; the ones which
+	// read or write segment files release it for the I/O. Reading a segment
+	// back or spilling one changes where it is kept, not what it holds, so
+	// the queries which do so are still const.
+
+	// the slot of key once it is not moving, or end()
+	slot_iterator settled(std::unique_lock<std::mutex>& lock, key_type key) const
+	{
+		for (;;)
+		{
+			auto p = segments_.find(key);
+			if (p == segments_.end() || !p->second.moving)
+				return p;
+			moved_.wait(lock);
+		}
+	}
+
+	// the segment of a settled slot, read back if it was spilled, marked as
+	// the most recently used
+	segment_ptr resident(std::unique_lock<std::mutex>& lock, slot_iterator p) const
+	{
+		slot& s = p->second;
+		if (s.resident)
+		{
+			recent_.splice(recent_.begin(), recent_, s.recent);
+			return s.resident;
+		}
+
+		const key_type key = p->first;
+		const std::string path = s.path;
+		segment_ptr loaded;
+		std::exception_ptr failure;
+
+		s.moving = true;
+		lock.unlock();
+		try
+		{
+			loaded = load(key, path);
+			std::remove(path.c_str());
+		}
+		catch (...)
+		{
+			failure = std::current_exception();
+		}
+		lock.lock();
+		s.moving = false;
+		moved_.notify_all();
+
+		if (failure)
+			std::rethrow_exception(failure); // still spilled
+		s.resident = loaded;
+		recent_.push_front(key);
+		s.recent = recent_.begin();
+		return s.resident;
+	}
+
+	// spills the least recently used segments nobody else holds until the
+	// budget is met (or nothing more can be spilled)
+	void trim(std::unique_lock<std::mutex>& lock) const
+	{
+		if (max_resident_ == 0)
+			return;
+
+		struct victim
+		{
+			key_type key;
+			segment_ptr segment;
+			std::string path;
+			std::size_t size;
+			std::exception_ptr failure;
+		};
+		std::vector<victim> victims;
+
+		auto p = recent_.end();
+		while (recent_.size() > max_resident_ && p != recent_.begin())
+		{
+			--p;
+			slot& s = segments_.find(*p)->second;
+			// every holder gets its pointer under mtx_, so a count of one
+			// (the slot) means no other thread is using the segment
+			if (s.resident.use_count() == 1)
+			{
+				s.moving = true;
+				victims.push_back(victim{ *p, s.resident, segment_path(*p), 0, nullptr });
+				p = recent_.erase(p);
+			}
+		}
+		if (victims.empty())
+			return;
+
+		lock.unlock();
+		for (victim& v : victims)
+		{
+			try
+			{
+				v.size = spill(*v.segment, v.path);
+			}
+			catch (...)
+			{
+				v.failure = std::current_exception();
+			}
+			v.segment.reset();
+		}
+		lock.lock();
+
+		for (const victim& v : victims)
+		{
+			slot& s = segments_.find(v.key)->second;
+			s.moving = false;
+			if (v.failure)
+			{
+				// kept in memory, as the least recently used
+				recent_.push_back(v.key);
+				s.recent = std::prev(recent_.end());
+				spill_error_ = v.failure;
+			}
+			else
+			{
+				s.resident.reset();
+				s.spilled_size = v.size;
+				s.path = v.path;
+			}
+		}
+		moved_.notify_all();
+	}
+
+	// the slot (which is settled) is about to be erased; its file, if any,
+	// is added to files to be removed after the lock is released
+	void forget(slot& s, std::vector<std::string>& files) const
+	{
+		if (s.resident)
+			recent_.erase(s.recent);
+		else
+			files.push_back(s.path);
+	}
+
+	static void remove_files(const std::vector<std::string>& files)
+	{
+		for (const std::string& file : files)
+			std::remove(file.c_str());
+	}
+
+	std::string segment_path(key_type key) const
+	{
+		return directory_ + "/segment_" + std::to_string(key) + ".seg";
+	}
+
+	// writes a segment to path; returns its number of buckets
+	std::size_t spill(segment& seg, const std::string& path) const
+	{
+		std::string data;
+		std::size_t size;
+		{
+			std::lock_guard<std::mutex> lock(seg.mutex);
+			const bucket_type& bucket = seg.bucket;
+
+			encode_varint(data, bucket.size());
+			index_type previous = bucket.low();
+			for (auto p = bucket.begin(); p != bucket.end(); ++p)
+			{
+				encode_boundary(data, previous, p->first, std::is_integral<index_type>());
+				encode_boundary(data, p->first, p->second, std::is_integral<index_type>());
+				previous = p->second;
+
+				std::uint64_t count = 0;
+				for (auto v = p->third.begin(); v != p->third.end(); ++v)
+					count++;
+				encode_varint(data, count);
+				for (auto v = p->third.begin(); v != p->third.end(); ++v)
+					encode(data, *v);
+			}
+			size = bucket.size();
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		file.write(data.data(), static_cast<std::streamsize>(data.size()));
+		if (!file)
+			throw std::runtime_error("Cannot write segment file " + path + ".");
+		return size;
+	}
+
+	segment_ptr load(key_type key, const std::string& path) const
+	{
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open())
+			throw std::runtime_error("Cannot read segment file " + path + ".");
+		const std::string data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+		segment_ptr s = std::make_shared<segment>(segment_low(key), segment_high(key));
+		const char* p = data.data();
+		const char* end = data.data() + data.size();
+
+		// the buckets are in order, so the cursor never has to search
+		typename bucket_type::cursor cursor(s->bucket);
+		std::uint64_t count;
+		if (!decode_varint(p, end, count))
+			throw std::runtime_error("Segment file " + path + " is corrupt.");
+		index_type previous = s->bucket.low();
+		for (std::uint64_t i = 0; i < count; ++i)
+		{
+			index_type first, second;
+			std::uint64_t values;
+			if (!decode_boundary(p, end, previous, first, std::is_integral<index_type>()) ||
+			    !decode_boundary(p, end, first, second, std::is_integral<index_type>()) ||
+			    !decode_varint(p, end, values))
+				throw std::runtime_error("Segment file " + path + " is corrupt.");
+			previous = second;
+
+			for (std::uint64_t v = 0; v < values; ++v)
+			{
+				value_type value;
+				if (!decode(p, end, value))
+					throw std::runtime_error("Segment file " + path + " is corrupt.");
+				if (v == 0)
+					cursor.cover(first, second, value);
+				else
+					cursor.spread(first, second, value);
+			}
+		}
+		return s;
+	}
+
+	// integral boundaries are stored as the distance from the previous one
+	static void encode_boundary(std::string& out, const index_type& previous, const index_type& boundary, std::true_type)
+	{
+		encode_varint(out, static_cast<std::uint64_t>(boundary) - static_cast<std::uint64_t>(previous));
+	}
+
+	static void encode_boundary(std::string& out, const index_type&, const index_type& boundary, std::false_type)
+	{
+		encode(out, boundary);
+	}
+
+	static bool decode_boundary(const char*& p, const char* end, const index_type& previous, index_type& boundary, std::true_type)
+	{
+		std::uint64_t distance;
+		if (!decode_varint(p, end, distance))
+			return false;
+		boundary = static_cast<index_type>(static_cast<std::uint64_t>(previous) + distance);
+		return true;
+	}
+
+	static bool decode_boundary(const char*& p, const char* end, const index_type&, index_type& boundary, std::false_type)
+	{
+		return decode(p, end, boundary);
+	}
+
+	index_type width_;
+	index_type origin_;
+
+	mutable std::map<key_type, slot> segments_;
+	// resident segments, most recently used first
+	mutable std::list<key_type> recent_;
+	std::string directory_;
+	std::size_t max_resident_ = 0;
+	mutable std::exception_ptr spill_error_;
+	mutable std::mutex mtx_;
+	// signalled whenever slots stop moving
+	mutable std::condition_variable moved_;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_SEGMENTED_BUCKETS_H_
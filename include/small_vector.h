@@ -0,0 +1,284 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// small_vector.h - Vector with inline storage for the first few elements
+
+#ifndef MASUTILS_SMALL_VECTOR_H_
+#define MASUTILS_SMALL_VECTOR_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace masutils {
+
+// A small_vector keeps its first N elements inside the object itself and only
+// allocates once more than N elements are added. Most buckets hold one or a
+// handful of values, so using a small_vector as the value container means the
+// typical bucket never allocates for its values, and splitting a bucket is a
+// plain copy of the bucket instead of a copy plus allocations.
+//
+// Only the part of the std::vector interface needed by the value container
+// traits (and by code which reads value containers) is provided.
+template <class T, std::size_t N>
+class small_vector
+{
+	static_assert(N > 0, "small_vector needs an inline capacity of at least one element");
+
+public:
+	typedef T value_type;
+	typedef std::size_t size_type;
+	typedef std::ptrdiff_t difference_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T* iterator;
+	typedef const T* const_iterator;
+
+	small_vector() noexcept : data_(inline_data()), size_(0), capacity_(N) {}
+
+	small_vector(std::initializer_list<T> init) : small_vector()
+	{
+		insert(end(), init.begin(), init.end());
+	}
+
+	small_vector(const small_vector& other) : small_vector()
+	{
+		insert(end(), other.begin(), other.end());
+	}
+
+	small_vector(small_vector&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+		: small_vector()
+	{
+		take(other);
+	}
+
+	~small_vector()
+	{
+		clear();
+		release();
+	}
+
+	small_vector& operator=(const small_vector& other)
+	{
+		if (this != &other)
+		{
+			clear();
+			insert(end(), other.begin(), other.end());
+		}
+		return *this;
+	}
+
+	small_vector& operator=(small_vector&& other) noexcept(std::is_nothrow_move_constructible<T>::value)
+	{
+		if (this != &other)
+		{
+			clear();
+			release();
+			take(other);
+		}
+		return *this;
+	}
+
+	iterator begin() noexcept { return data_; }
+	iterator end() noexcept { return data_ + size_; }
+	const_iterator begin() const noexcept { return data_; }
+	const_iterator end() const noexcept { return data_ + size_; }
+	const_iterator cbegin() const noexcept { return data_; }
+	const_iterator cend() const noexcept { return data_ + size_; }
+
+	size_type size() const noexcept { return size_; }
+	size_type capacity() const noexcept { return capacity_; }
+	bool empty() const noexcept { return size_ == 0; }
+
+	// true while the elements are still stored inside the object
+	bool is_inline() const noexcept { return data_ == inline_data(); }
+
+	reference operator[](size_type i) { return data_[i]; }
+	const_reference operator[](size_type i) const { return data_[i]; }
+	reference front() { return data_[0]; }
+	const_reference front() const { return data_[0]; }
+	reference back() { return data_[size_ - 1]; }
+	const_reference back() const { return data_[size_ - 1]; }
+	pointer data() noexcept { return data_; }
+	const_pointer data() const noexcept { return data_; }
+
+	void reserve(size_type capacity)
+	{
+		if (capacity > capacity_)
+			grow(capacity);
+	}
+
+	void push_back(const T& value)
+	{
+		if (size_ == capacity_)
+		{
+			T copy(value); // value may live in this container
+			grow(next_capacity());
+			new (data_ + size_) T(std::move(copy));
+		}
+		else
+			new (data_ + size_) T(value);
+		++size_;
+	}
+
+	void push_back(T&& value)
+	{
+		if (size_ == capacity_)
+		{
+			T moved(std::move(value));
+			grow(next_capacity());
+			new (data_ + size_) T(std::move(moved));
+		}
+		else
+			new (data_ + size_) T(std::move(value));
+		++size_;
+	}
+
+	void pop_back()
+	{
+		data_[--size_].~T();
+	}
+
+	template <class InputIt>
+	iterator insert(const_iterator position, InputIt first, InputIt last)
+	{
+		const size_type offset = static_cast<size_type>(position - data_);
+		const size_type old_size = size_;
+		for (; first != last; ++first)
+			push_back(*first);
+		std::rotate(data_ + offset, data_ + old_size, data_ + size_);
+		return data_ + offset;
+	}
+
+	iterator insert(const_iterator position, const T& value)
+	{
+		const size_type offset = static_cast<size_type>(position - data_);
+		push_back(value);
+		std::rotate(data_ + offset, data_ + size_ - 1, data_ + size_);
+		return data_ + offset;
+	}
+
+	iterator erase(const_iterator first, const_iterator last)
+	{
+		iterator f = data_ + (first - data_);
+		iterator l = data_ + (last - data_);
+		iterator e = std::move(l, end(), f);
+		while (end() != e)
+			pop_back();
+		return f;
+	}
+
+	iterator erase(const_iterator position)
+	{
+		return erase(position, position + 1);
+	}
+
+	void clear() noexcept
+	{
+		while (size_ > 0)
+			pop_back();
+	}
+
+	friend bool operator==(const small_vector& x, const small_vector& y)
+	{
+		return std::equal(x.begin(), x.end(), y.begin(), y.end());
+	}
+
+	friend bool operator!=(const small_vector& x, const small_vector& y)
+	{
+		return !(x == y);
+	}
+
+private:
+	T* inline_data() noexcept { return reinterpret_cast<T*>(&inline_); }
+	const T* inline_data() const noexcept { return reinterpret_cast<const T*>(&inline_); }
+
+	// the capacity after the inline or heap storage is full: twice as much,
+	// and never less than one more element (which the compiler cannot tell
+	// from capacity_ * 2 alone, and warns about writing past a zero sized
+	// allocation)
+	size_type next_capacity() const noexcept
+	{
+		const size_type doubled = static_cast<size_type>(capacity_) * 2;
+		const size_type needed = static_cast<size_type>(size_) + 1;
+		return doubled < needed ? needed : doubled;
+	}
+
+	void grow(size_type capacity)
+	{
+		T* data = static_cast<T*>(::operator new(capacity * sizeof(T)));
+		for (size_type i = 0; i < size_; ++i)
+		{
+			new (data + i) T(std::move(data_[i]));
+			data_[i].~T();
+		}
+		release();
+		data_ = data;
+		capacity_ = static_cast<std::uint32_t>(capacity);
+	}
+
+	// frees the heap storage (if any); the elements must already be destroyed
+	void release() noexcept
+	{
+		if (!is_inline())
+			::operator delete(data_);
+		data_ = inline_data();
+		capacity_ = N;
+	}
+
+	// steals the elements of other, which must be empty afterwards; this
+	// object must be empty and inline
+	void take(small_vector& other)
+	{
+		if (other.is_inline())
+		{
+			for (size_type i = 0; i < other.size_; ++i)
+				new (data_ + i) T(std::move(other.data_[i]));
+			size_ = other.size_;
+			other.clear();
+		}
+		else
+		{
+			data_ = other.data_;
+			size_ = other.size_;
+			capacity_ = other.capacity_;
+			other.data_ = other.inline_data();
+			other.size_ = 0;
+			other.capacity_ = N;
+		}
+	}
+
+	T* data_;
+	std::uint32_t size_;
+	std::uint32_t capacity_;
+	typename std::aligned_storage<sizeof(T) * N, alignof(T)>::type inline_;
+};
+
+// Inline capacity used by the default value containers: as many elements as
+// fit in 32 bytes, but never less than one.
+template <class T>
+struct small_vector_default_capacity
+	: std::integral_constant<std::size_t, (sizeof(T) < 32 ? 32 / sizeof(T) : 1)> {};
+
+} // namespace masutils
+
+#endif // MASUTILS_SMALL_VECTOR_H_
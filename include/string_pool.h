@@ -0,0 +1,182 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// string_pool.h - Interned strings for string valued buckets
+
+#ifndef MASUTILS_STRING_POOL_H_
+#define MASUTILS_STRING_POOL_H_
+
+#ifndef MASUTILS_BUCKETS_SUPP_H_
+#error Must include buckets_supp.h first
+#endif
+
+#ifndef CCTYPE_H_
+#include <cctype>
+#endif // CCTYPE_H_
+
+#ifndef MUTEX_H_
+#include <mutex>
+#endif // MUTEX_H_
+
+#ifndef SET_H_
+#include <set>
+#endif // SET_H_
+
+#ifndef STRING_H_
+#include <string>
+#endif // STRING_H_
+
+namespace masutils {
+
+// A string_pool stores every distinct string exactly once, together with its
+// case folded (lower case) form. Entries are never removed or moved, so a
+// pointer to an entry stays valid for the life of the pool.
+template <typename CharT>
+class string_pool {
+public:
+	typedef std::basic_string<CharT> string_type;
+
+	struct entry {
+		string_type value;
+		string_type folded;
+	};
+
+	string_pool() = default;
+	string_pool(const string_pool&) = delete;
+	string_pool& operator=(const string_pool&) = delete;
+
+	const entry* intern(const string_type& value)
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		auto found = entries_.find(value);
+		if (found != entries_.end())
+			return &*found;
+
+		entry e{ value, value };
+		for (auto& c : e.folded)
+			c = static_cast<CharT>(std::tolower(c));
+		return &*entries_.insert(std::move(e)).first;
+	}
+
+	std::size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		return entries_.size();
+	}
+
+	// The pool used by interned_string.
+	static string_pool& global()
+	{
+		static string_pool pool;
+		return pool;
+	}
+
+private:
+	struct entry_less {
+		typedef void is_transparent;
+		bool operator()(const entry& x, const entry& y) const { return x.value < y.value; }
+		bool operator()(const entry& x, const string_type& y) const { return x.value < y; }
+		bool operator()(const string_type& x, const entry& y) const { return x < y.value; }
+	};
+
+	std::set<entry, entry_less> entries_;
+	mutable std::mutex mtx_;
+};
+
+// An interned_string is a handle to a string in the global string_pool. It is
+// the size of a pointer, copying it never copies characters, and two handles
+// are equal exactly when they point to the same entry. It provides enough of
+// the std::basic_string interface to be used as the value of a glossary.
+template <typename CharT>
+class interned_string {
+public:
+	typedef string_pool<CharT> pool_type;
+	typedef typename pool_type::string_type string_type;
+	typedef typename string_type::size_type size_type;
+	typedef CharT value_type;
+	typedef const CharT* const_iterator;
+	typedef const_iterator iterator;
+
+	interned_string() : entry_(pool_type::global().intern(string_type())) {}
+	interned_string(const CharT* value) : entry_(pool_type::global().intern(value)) {}
+	interned_string(const string_type& value) : entry_(pool_type::global().intern(value)) {}
+
+	const string_type& str() const noexcept { return entry_->value; }
+	const string_type& folded() const noexcept { return entry_->folded; }
+	const CharT* c_str() const noexcept { return entry_->value.c_str(); }
+
+	size_type size() const noexcept { return entry_->value.size(); }
+	bool empty() const noexcept { return entry_->value.empty(); }
+	CharT operator[](size_type i) const { return entry_->value[i]; }
+	const_iterator begin() const noexcept { return entry_->value.data(); }
+	const_iterator end() const noexcept { return entry_->value.data() + entry_->value.size(); }
+
+	friend bool operator==(const interned_string& x, const interned_string& y) noexcept { return x.entry_ == y.entry_; }
+	friend bool operator!=(const interned_string& x, const interned_string& y) noexcept { return x.entry_ != y.entry_; }
+	friend bool operator<(const interned_string& x, const interned_string& y) { return x.entry_ != y.entry_ && x.str() < y.str(); }
+
+private:
+	const typename pool_type::entry* entry_;
+};
+
+// Same ordering as the generic caseInsensitiveLess (only the common prefix
+// is compared), but on the folded form kept in the pool instead of folding
+// every character of both strings on every comparison. The folded characters
+// still go through std::tolower (which leaves them as they are) so that they
+// are compared exactly like the generic one compares them: as the int it
+// returns, not as basic_string::compare does, which could order characters
+// with the high bit set differently.
+template <typename CharT>
+struct caseInsensitiveLess<interned_string<CharT>> {
+	bool operator()(const interned_string<CharT>& lhs, const interned_string<CharT>& rhs) const
+	{
+		if (lhs == rhs)
+			return false;
+
+		const auto& x = lhs.folded();
+		const auto& y = rhs.folded();
+		const auto bound = x.size() < y.size() ? x.size() : y.size();
+		for (typename std::basic_string<CharT>::size_type i = 0; i < bound; ++i)
+		{
+			if (std::tolower(x[i]) < std::tolower(y[i]))
+				return true;
+
+			if (std::tolower(y[i]) < std::tolower(x[i]))
+				return false;
+		}
+		return false;
+	}
+};
+
+template <typename CharT>
+class bucket_value_wrapper<interned_string<CharT>> {
+public:
+	explicit bucket_value_wrapper(const interned_string<CharT>& value_) noexcept : value(value_) {}
+
+	friend std::ostream& operator<<(std::ostream& os, const bucket_value_wrapper<interned_string<CharT>>& wrapper) {
+		os << "\"" << wrapper.get().str() << "\"";
+		return os;
+	}
+
+	const interned_string<CharT>& get() const noexcept {
+		return value;
+	}
+
+private:
+	const interned_string<CharT> value;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_STRING_POOL_H_
@@ -0,0 +1,194 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// sweep_cursor.h - Walk a buckets forward in time, reporting values as they start and stop
+
+#ifndef MASUTILS_SWEEP_CURSOR_H_
+#define MASUTILS_SWEEP_CURSOR_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef ALGORITHM_H_
+#include <algorithm>
+#endif // ALGORITHM_H_
+
+#ifndef FUNCTIONAL_H_
+#include <functional>
+#endif // FUNCTIONAL_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+// A sweep_cursor follows a time (any index) which only moves forward through
+// a buckets, e.g. the clock of a simulation or a dispatcher. It keeps the
+// bucket holding the time and the (sorted) values active at that time:
+//
+//     sweep_cursor<work_bucket> cursor(bucket);
+//     cursor.advance(now, [](const std::string& v) { /* v started */ },
+//                         [](const std::string& v) { /* v stopped */ });
+//
+// advance() walks through every bucket (and gap) between the previous time
+// and the new one, and reports the change from each one to the next:
+// leave(value) for every value active before but not after, then
+// enter(value) for every value active after but not before (a value held
+// twice counts twice). So a value which starts and stops between two calls
+// is still reported, with an enter followed by a leave. A call which stays
+// in the same bucket (or gap) costs nothing, so the sweep is linear in the
+// number of buckets passed plus their values. The values of each bucket are
+// sorted once when it is entered, unless they already are sorted (e.g. the
+// std::set of unique_bucket_value_traits), in which case that is only a
+// check.
+//
+// Like an iterator, the cursor is invalidated by edits of the buckets.
+template <class Bucket, class Compare = std::less<typename Bucket::value_type>>
+class sweep_cursor
+{
+public:
+	typedef Bucket bucket_type;
+	typedef typename Bucket::index_type index_type;
+	typedef typename Bucket::value_type value_type;
+	typedef typename Bucket::traits_type traits_type;
+	typedef typename Bucket::const_iterator const_iterator;
+
+	explicit sweep_cursor(const bucket_type& bucket)
+		: bucket_(&bucket), next_(bucket.begin()), current_(bucket.end()), time_(), started_(false)
+	{
+	}
+
+	// Moves to time, which may not be before the previous one. Returns true
+	// when the cursor moved to another bucket (or gap), or passed through one.
+	template <class Enter, class Leave>
+	bool advance(const index_type& time, Enter enter, Leave leave)
+	{
+		if (started_ && traits_type::lt(time, time_))
+			throw std::logic_error("A sweep cannot go back in time.");
+		traits_type::assign(time_, time);
+		started_ = true;
+
+		const const_iterator end = bucket_->end();
+		bool moved = false;
+
+		// every bucket which ends at or before time is passed through (unless
+		// it is the one the cursor is already in)
+		while (next_ != end && !traits_type::lt(time, next_->second))
+		{
+			if (next_ != current_)
+				moved |= enter_bucket(next_, enter, leave);
+			++next_;
+		}
+
+		if (next_ != end && !traits_type::lt(time, next_->first))
+			moved |= enter_bucket(next_, enter, leave);
+		else
+			moved |= move_to(end, enter, leave);
+		return moved;
+	}
+
+	// the bucket holding the time, end() when it is in a gap
+	const_iterator current() const noexcept { return current_; }
+
+	const index_type& time() const noexcept { return time_; }
+
+	// the values active at the time, sorted by Compare
+	const std::vector<value_type>& active() const noexcept { return active_; }
+
+	// The next index where the active values can change: the end of the
+	// current bucket, or the start of the next one. False after the last.
+	bool next_change(index_type& at) const
+	{
+		if (current_ != bucket_->end())
+		{
+			traits_type::assign(at, current_->second);
+			return true;
+		}
+		if (next_ != bucket_->end())
+		{
+			traits_type::assign(at, next_->first);
+			return true;
+		}
+		return false;
+	}
+
+private:
+	// moves into bucket, through the gap before it when there is one
+	template <class Enter, class Leave>
+	bool enter_bucket(const_iterator bucket, Enter& enter, Leave& leave)
+	{
+		bool moved = false;
+		if (current_ != bucket_->end() && current_ != bucket && !traits_type::eq(current_->second, bucket->first))
+			moved = move_to(bucket_->end(), enter, leave);
+		return move_to(bucket, enter, leave) || moved;
+	}
+
+	// reports the change from the current bucket (or gap) to now
+	template <class Enter, class Leave>
+	bool move_to(const_iterator now, Enter& enter, Leave& leave)
+	{
+		if (now == current_)
+			return false;
+
+		incoming_.clear();
+		if (now != bucket_->end())
+		{
+			incoming_.assign(now->third.begin(), now->third.end());
+			if (!std::is_sorted(incoming_.begin(), incoming_.end(), compare_))
+				std::sort(incoming_.begin(), incoming_.end(), compare_);
+		}
+
+		report(active_, incoming_, leave);
+		report(incoming_, active_, enter);
+
+		active_.swap(incoming_);
+		current_ = now;
+		return true;
+	}
+
+	// calls f for every value of from which is not in to (both sorted)
+	template <class F>
+	void report(const std::vector<value_type>& from, const std::vector<value_type>& to, F& f) const
+	{
+		auto b = to.begin();
+		for (auto a = from.begin(); a != from.end(); ++a)
+		{
+			while (b != to.end() && compare_(*b, *a))
+				++b;
+			if (b != to.end() && !compare_(*a, *b))
+				++b; // in both
+			else
+				f(*a);
+		}
+	}
+
+	const bucket_type* bucket_;
+	const_iterator next_;    // first bucket which ends after the time
+	const_iterator current_; // bucket holding the time, or end()
+	index_type time_;
+	bool started_;
+	Compare compare_;
+	std::vector<value_type> active_;
+	std::vector<value_type> incoming_;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_SWEEP_CURSOR_H_
@@ -0,0 +1,92 @@
+#ifndef MASTEST_SEARCH_CHECK_H_
+#define MASTEST_SEARCH_CHECK_H_
+
+#ifndef MASUTILS_BOUNDARY_SEARCH_H_
+#error Must include boundary_search.h first
+#endif // !MASUTILS_BOUNDARY_SEARCH_H_
+
+#ifndef ALGORITHM_H_
+#include <algorithm>
+#endif // !ALGORITHM_H_
+
+#ifndef LIMITS_H_
+#include <limits>
+#endif // !LIMITS_H_
+
+#ifndef RANDOM_H_
+#include <random>
+#endif // !RANDOM_H_
+
+#ifndef SSTREAM_H_
+#include <sstream>
+#endif // !SSTREAM_H_
+
+#ifndef STRING_H_
+#include <string>
+#endif // !STRING_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // !VECTOR_H_
+
+namespace mastest {
+
+// Internal linkage: each test translation unit checks the search it was
+// compiled with (see the inline namespaces of boundary_search.h), so the
+// checks must not be merged by the linker either.
+namespace {
+
+// Compares search_lower_bound and search_upper_bound of Traits against
+// std::lower_bound and std::upper_bound with order, on seeded random sorted
+// arrays of every length up to max_n. The arrays hold low + k * scale for
+// random k, with repeats; the keys are every element, its neighbours and the
+// limits of Index. Returns an empty string, or a description of the first
+// mismatch.
+template <class Traits, class Index, class Order>
+std::string check_boundary_search(unsigned seed, std::size_t max_n, Index low, Index scale, Order order)
+{
+	std::mt19937 random(seed);
+	std::vector<Index> data;
+	std::vector<Index> keys;
+
+	for (std::size_t n = 0; n <= max_n; ++n)
+	{
+		data.clear();
+		for (std::size_t i = 0; i < n; ++i)
+			data.push_back(static_cast<Index>(low + static_cast<Index>(random() % (4 * n + 8)) * scale));
+		std::sort(data.begin(), data.end(), order);
+
+		keys.clear();
+		keys.push_back(std::numeric_limits<Index>::min());
+		keys.push_back(std::numeric_limits<Index>::max());
+		for (const Index& x : data)
+		{
+			keys.push_back(static_cast<Index>(x - 1));
+			keys.push_back(x);
+			keys.push_back(static_cast<Index>(x + 1));
+		}
+
+		for (const Index& key : keys)
+		{
+			const std::size_t lower = std::lower_bound(data.begin(), data.end(), key, order) - data.begin();
+			const std::size_t upper = std::upper_bound(data.begin(), data.end(), key, order) - data.begin();
+			const std::size_t searched_lower = masutils::search_lower_bound<Traits>(data.data(), n, key);
+			const std::size_t searched_upper = masutils::search_upper_bound<Traits>(data.data(), n, key);
+			if (searched_lower != lower || searched_upper != upper)
+			{
+				std::ostringstream os;
+				os << "n " << n << " key " << key
+				   << ": lower_bound " << searched_lower << " instead of " << lower
+				   << ", upper_bound " << searched_upper << " instead of " << upper;
+				return os.str();
+			}
+		}
+	}
+	return std::string();
+}
+
+} // namespace
+
+} // namespace mastest
+
+#endif // !MASTEST_SEARCH_CHECK_H_
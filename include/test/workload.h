@@ -0,0 +1,235 @@
+#ifndef MASTEST_WORKLOAD_H_
+#define MASTEST_WORKLOAD_H_
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // !CSTDINT_H_
+
+#ifndef RANDOM_H_
+#include <random>
+#endif // !RANDOM_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // !VECTOR_H_
+
+// Seeded, synthetic workloads which look like the schedules buckets hold in
+// practice, for benchmarks and stress tests. A workload is a list of spread
+// and cover edits; the same options (and seed) give the same edits on every
+// platform, since only the raw output of std::mt19937 and integer arithmetic
+// are used (the std distributions differ between standard libraries).
+//
+// Indices are seconds from the origin of the options; values are small ints:
+// workload_open and workload_lunch, then one id per person or calendar.
+
+namespace mastest {
+
+enum class workload_kind { spread, cover };
+
+template <class Index>
+struct workload_edit
+{
+	workload_kind kind;
+	Index low;
+	Index high;
+	int value;
+};
+
+const int workload_open = 0;  // opening hours
+const int workload_lunch = 1; // lunch break, covering everything under it
+const int workload_first_id = 2;
+
+const long long workload_minute = 60;
+const long long workload_hour = 60 * workload_minute;
+const long long workload_day = 24 * workload_hour;
+
+class workload_random
+{
+public:
+	explicit workload_random(unsigned seed) : engine_(seed) {}
+
+	// in [0, n)
+	long long uniform(long long n)
+	{
+		return n <= 0 ? 0 : static_cast<long long>(next() % static_cast<std::uint64_t>(n));
+	}
+
+	// in [low, high), a multiple of step from low
+	long long uniform(long long low, long long high, long long step)
+	{
+		return low + uniform((high - low + step - 1) / step) * step;
+	}
+
+	bool chance(int percent)
+	{
+		return uniform(100) < percent;
+	}
+
+	// A long tailed length: at least shortest, then doubled (in part) with a
+	// chance of tail_percent at every step, up to longest. Most lengths stay
+	// short, a few run long.
+	long long long_tail(long long shortest, long long longest, int tail_percent, long long step)
+	{
+		long long length = shortest + uniform(0, shortest, step);
+		while (length < longest && chance(tail_percent))
+			length += uniform(0, length, step) + step;
+		return length < longest ? length : longest;
+	}
+
+private:
+	std::uint64_t next()
+	{
+		// two statements, so that the draws happen in this order everywhere
+		const std::uint64_t high = engine_();
+		const std::uint64_t low = engine_();
+		return (high << 32) | low;
+	}
+
+	std::mt19937 engine_;
+};
+
+// Staff rosters: every day the shop is opened (a daily recurring spread),
+// shifts of long tailed lengths are spread for random people with starts
+// clustered around the rush, and some shifts get a lunch break which covers
+// the middle of it, like example7 and example8 in bucket/main.cpp.
+struct roster_options
+{
+	unsigned seed = 1;
+	long long origin = 0;
+	int days = 7;
+	int staff = 20;
+	int shifts_per_day = 12;
+	int opening_hour = 7;
+	int closing_hour = 19;
+	int rush_hour = 8;        // rush starts...
+	int rush_hours = 4;       // ...and lasts
+	int rush_percent = 50;    // of the shifts start around the rush
+	int lunch_percent = 30;   // of the shifts get a lunch cover
+	int tail_percent = 35;    // chance of a shift being extended
+};
+
+template <class Index>
+std::vector<workload_edit<Index>> make_roster_workload(const roster_options& options)
+{
+	std::vector<workload_edit<Index>> edits;
+	workload_random random(options.seed);
+
+	const long long quarter = 15 * workload_minute;
+
+	for (int day = 0; day < options.days; ++day)
+	{
+		const long long midnight = options.origin + day * workload_day;
+		const long long opening = midnight + options.opening_hour * workload_hour;
+		const long long closing = midnight + options.closing_hour * workload_hour;
+		const long long rush = midnight + options.rush_hour * workload_hour;
+
+		edits.push_back(workload_edit<Index>{ workload_kind::spread,
+			static_cast<Index>(opening), static_cast<Index>(closing), workload_open });
+
+		std::vector<workload_edit<Index>> lunches;
+		for (int shift = 0; shift < options.shifts_per_day; ++shift)
+		{
+			const int person = workload_first_id + static_cast<int>(random.uniform(options.staff));
+
+			const long long start = random.chance(options.rush_percent)
+				? random.uniform(rush - 2 * workload_hour, rush + options.rush_hours * workload_hour / 2, quarter)
+				: random.uniform(opening - 3 * workload_hour, closing - 2 * workload_hour, quarter);
+			const long long length = random.long_tail(2 * workload_hour, 16 * workload_hour, options.tail_percent, quarter);
+
+			edits.push_back(workload_edit<Index>{ workload_kind::spread,
+				static_cast<Index>(start), static_cast<Index>(start + length), person });
+
+			if (length >= 4 * workload_hour && random.chance(options.lunch_percent))
+			{
+				const long long lunch = start + length / 2 / quarter * quarter;
+				lunches.push_back(workload_edit<Index>{ workload_kind::cover,
+					static_cast<Index>(lunch), static_cast<Index>(lunch + 2 * quarter * (1 + random.uniform(2))), workload_lunch });
+			}
+		}
+
+		// breaks are painted over the finished day
+		edits.insert(edits.end(), lunches.begin(), lunches.end());
+	}
+
+	return edits;
+}
+
+// Calendars: meetings of long tailed lengths (most short, a few all day)
+// clustered in working hours on week days, plus weekly recurring meetings.
+struct calendar_options
+{
+	unsigned seed = 1;
+	long long origin = 0;
+	int weeks = 4;
+	int calendars = 50;
+	int meetings_per_day = 40;
+	int recurring = 10;       // weekly meetings, repeated every week
+	int tail_percent = 30;
+};
+
+template <class Index>
+std::vector<workload_edit<Index>> make_calendar_workload(const calendar_options& options)
+{
+	std::vector<workload_edit<Index>> edits;
+	workload_random random(options.seed);
+
+	const long long slot = 5 * workload_minute;
+	auto meeting = [&](long long day_start, long long& start, long long& length) {
+		start = random.uniform(day_start + 8 * workload_hour, day_start + 17 * workload_hour, slot);
+		length = random.long_tail(15 * workload_minute, 8 * workload_hour, options.tail_percent, slot);
+	};
+
+	struct weekly { int day; long long start; long long length; int calendar; };
+	std::vector<weekly> recurring;
+	for (int i = 0; i < options.recurring; ++i)
+	{
+		long long start, length;
+		meeting(0, start, length);
+		recurring.push_back(weekly{ static_cast<int>(random.uniform(5)), start, length,
+			workload_first_id + static_cast<int>(random.uniform(options.calendars)) });
+	}
+
+	for (int week = 0; week < options.weeks; ++week)
+	{
+		for (int day = 0; day < 5; ++day)
+		{
+			const long long day_start = options.origin + (week * 7 + day) * workload_day;
+
+			for (const auto& r : recurring)
+			{
+				if (r.day == day)
+					edits.push_back(workload_edit<Index>{ workload_kind::spread,
+						static_cast<Index>(day_start + r.start), static_cast<Index>(day_start + r.start + r.length), r.calendar });
+			}
+
+			for (int i = 0; i < options.meetings_per_day; ++i)
+			{
+				long long start, length;
+				meeting(day_start, start, length);
+				edits.push_back(workload_edit<Index>{ workload_kind::spread,
+					static_cast<Index>(start), static_cast<Index>(start + length),
+					workload_first_id + static_cast<int>(random.uniform(options.calendars)) });
+			}
+		}
+	}
+
+	return edits;
+}
+
+// Applies the edits, in order, to a bucket (or its cursor) whose values can
+// be made from an int.
+template <class Target, class Index>
+void apply_workload(Target& target, const std::vector<workload_edit<Index>>& edits)
+{
+	for (const auto& edit : edits)
+	{
+		if (edit.kind == workload_kind::spread)
+			target.spread(edit.low, edit.high, edit.value);
+		else
+			target.cover(edit.low, edit.high, edit.value);
+	}
+}
+
+} // namespace mastest
+
+#endif // !MASTEST_WORKLOAD_H_
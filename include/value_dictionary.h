@@ -0,0 +1,326 @@
+// Copyright 2024 Mark Solinski
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// value_dictionary.h - Dictionary encoded values and the bitset value container traits
+
+#ifndef MASUTILS_VALUE_DICTIONARY_H_
+#define MASUTILS_VALUE_DICTIONARY_H_
+
+#ifndef MASUTILS_BUCKETS_H_
+#error Must include buckets.h first
+#endif
+
+#ifndef CSTDINT_H_
+#include <cstdint>
+#endif // CSTDINT_H_
+
+#ifndef ITERATOR_H_
+#include <iterator>
+#endif // ITERATOR_H_
+
+#ifndef ATOMIC_H_
+#include <atomic>
+#endif // ATOMIC_H_
+
+#ifndef MAP_H_
+#include <map>
+#endif // MAP_H_
+
+#ifndef MEMORY_H_
+#include <memory>
+#endif // MEMORY_H_
+
+#ifndef MUTEX_H_
+#include <mutex>
+#endif // MUTEX_H_
+
+#ifndef STDEXCEPT_H_
+#include <stdexcept>
+#endif // STDEXCEPT_H_
+
+#ifndef VECTOR_H_
+#include <vector>
+#endif // VECTOR_H_
+
+namespace masutils {
+
+// A value_dictionary interns values into dense integer ids (0, 1, 2, ...) in
+// the order they are first seen. Each distinct value is stored exactly once.
+// Interning is thread safe. Looking up the value of an id takes no lock:
+// the values are reached through chunks which never move once allocated
+// (interning only ever fills new slots), so an id handed out by intern() can
+// be read while other threads intern more values.
+template <class V, class Compare = std::less<V>>
+class value_dictionary
+{
+public:
+	typedef V value_type;
+	typedef std::uint32_t id_type;
+
+	value_dictionary() = default;
+	value_dictionary(const value_dictionary&) = delete;
+	value_dictionary& operator=(const value_dictionary&) = delete;
+
+	id_type intern(const value_type& value)
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		auto found = ids_.find(value);
+		if (found != ids_.end())
+			return found->second;
+
+		const id_type id = static_cast<id_type>(size_.load(std::memory_order_relaxed));
+		auto inserted = ids_.insert(std::make_pair(value, id)).first;
+
+		std::size_t chunk, offset;
+		locate(id, chunk, offset);
+		if (!chunks_[chunk])
+			chunks_[chunk].reset(new const value_type*[first_chunk_size << chunk]);
+		chunks_[chunk][offset] = &inserted->first;
+
+		size_.store(id + std::size_t(1), std::memory_order_release);
+		return id;
+	}
+
+	// looks up the id of a value without interning it
+	bool find(const value_type& value, id_type& id) const
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		auto found = ids_.find(value);
+		if (found == ids_.end())
+			return false;
+		id = found->second;
+		return true;
+	}
+
+	const value_type& value(id_type id) const
+	{
+		std::size_t chunk, offset;
+		locate(id, chunk, offset);
+		return *chunks_[chunk][offset];
+	}
+
+	std::size_t size() const noexcept { return size_.load(std::memory_order_acquire); }
+
+	// The dictionary used by value_bitset unless another one is given.
+	static value_dictionary& global()
+	{
+		static value_dictionary dictionary;
+		return dictionary;
+	}
+
+private:
+	// chunk k holds first_chunk_size << k ids, enough chunks for every id_type
+	static constexpr std::size_t first_chunk_size = 64;
+	static constexpr std::size_t chunk_count = 27;
+
+	static void locate(id_type id, std::size_t& chunk, std::size_t& offset) noexcept
+	{
+		// chunk k starts at id first_chunk_size * (2^k - 1)
+		const std::size_t n = id / first_chunk_size + 1;
+		chunk = 0;
+		for (std::size_t m = n; m > 1; m >>= 1)
+			chunk++;
+		offset = id - first_chunk_size * ((std::size_t(1) << chunk) - 1);
+	}
+
+	std::map<value_type, id_type, Compare> ids_;
+	std::unique_ptr<const value_type*[]> chunks_[chunk_count];
+	std::atomic<std::size_t> size_{ 0 };
+	mutable std::mutex mtx_;
+};
+
+// A value_bitset is the set of values of a bucket stored as one bit per
+// dictionary id. Adding a whole bucket to another bucket is a word by word OR
+// (which the compiler vectorizes) and comparing two buckets is a compare of
+// their words, instead of node by node set operations.
+//
+// Iterating a value_bitset yields the values in dictionary id order (the order
+// the values were first seen), not in Compare order.
+template <class V, class Compare = std::less<V>>
+class value_bitset
+{
+public:
+	typedef V value_type;
+	typedef value_dictionary<V, Compare> dictionary_type;
+	typedef typename dictionary_type::id_type id_type;
+	typedef std::uint64_t word_type;
+	// up to 128 ids are stored inline in the bucket
+	typedef small_vector<word_type, 2> word_list;
+
+	static constexpr std::size_t word_bits = 64;
+
+	class const_iterator
+	{
+	public:
+		typedef std::forward_iterator_tag iterator_category;
+		typedef V value_type;
+		typedef std::ptrdiff_t difference_type;
+		typedef const V* pointer;
+		typedef const V& reference;
+
+		const_iterator(const value_bitset* bitset, std::size_t bit) : bitset_(bitset), bit_(bit)
+		{
+			seek();
+		}
+
+		reference operator*() const { return bitset_->dictionary_->value(static_cast<id_type>(bit_)); }
+		pointer operator->() const { return &**this; }
+
+		const_iterator& operator++()
+		{
+			++bit_;
+			seek();
+			return *this;
+		}
+
+		const_iterator operator++(int)
+		{
+			const_iterator previous(*this);
+			++*this;
+			return previous;
+		}
+
+		bool operator==(const const_iterator& other) const { return bit_ == other.bit_; }
+		bool operator!=(const const_iterator& other) const { return bit_ != other.bit_; }
+
+	private:
+		// moves to the next set bit at or after bit_ (or to the end)
+		void seek()
+		{
+			const std::size_t end_bit = bitset_->words_.size() * word_bits;
+			while (bit_ < end_bit)
+			{
+				const word_type word = bitset_->words_[bit_ / word_bits] >> (bit_ % word_bits);
+				if (word & 1)
+					return;
+				if (word == 0)
+					bit_ = (bit_ / word_bits + 1) * word_bits;
+				else
+					++bit_;
+			}
+			bit_ = end_bit;
+		}
+
+		const value_bitset* bitset_;
+		std::size_t bit_;
+	};
+
+	typedef const_iterator iterator;
+
+	value_bitset() noexcept : dictionary_(&dictionary_type::global()) {}
+	explicit value_bitset(dictionary_type& dictionary) noexcept : dictionary_(&dictionary) {}
+
+	const_iterator begin() const { return const_iterator(this, 0); }
+	const_iterator end() const { return const_iterator(this, words_.size() * word_bits); }
+
+	void insert(const value_type& value)
+	{
+		set(dictionary_->intern(value));
+	}
+
+	bool contains(const value_type& value) const
+	{
+		id_type id;
+		if (!dictionary_->find(value, id))
+			return false;
+		const std::size_t w = id / word_bits;
+		return w < words_.size() && ((words_[w] >> (id % word_bits)) & 1);
+	}
+
+	// this = this | other; both must use the same dictionary (the ids of
+	// different dictionaries mean different values)
+	void unite(const value_bitset& other)
+	{
+		if (dictionary_ != other.dictionary_)
+			throw std::invalid_argument("Value bitsets of different dictionaries cannot be united.");
+
+		while (words_.size() < other.words_.size())
+			words_.push_back(0);
+
+		word_type* x = words_.data();
+		const word_type* y = other.words_.data();
+		const std::size_t n = other.words_.size();
+		for (std::size_t i = 0; i < n; ++i)
+			x[i] |= y[i];
+	}
+
+	std::size_t size() const noexcept
+	{
+		std::size_t count = 0;
+		for (std::size_t i = 0; i < words_.size(); ++i)
+			for (word_type word = words_[i]; word; word &= word - 1)
+				count++;
+		return count;
+	}
+
+	bool empty() const noexcept { return words_.empty(); }
+
+	const dictionary_type& dictionary() const noexcept { return *dictionary_; }
+
+	// trailing words are never zero, so equal sets have identical words
+	friend bool operator==(const value_bitset& x, const value_bitset& y)
+	{
+		return x.words_ == y.words_;
+	}
+
+	friend bool operator!=(const value_bitset& x, const value_bitset& y)
+	{
+		return !(x == y);
+	}
+
+private:
+	void set(id_type id)
+	{
+		const std::size_t w = id / word_bits;
+		while (words_.size() <= w)
+			words_.push_back(0);
+		words_[w] |= word_type(1) << (id % word_bits);
+	}
+
+	dictionary_type* dictionary_;
+	word_list words_;
+};
+
+// Value container traits which behave like unique_bucket_value_traits (each
+// value is held at most once per bucket) but store each bucket's values as a
+// value_bitset over a shared value_dictionary.
+template<class E, class Compare = std::less<E> >
+struct bitset_bucket_value_traits {
+
+	typedef E  value_type;
+	typedef value_bitset<E, Compare> value_container;
+
+	static void add(value_container& x, const value_type& y)
+	{
+		x.insert(y);
+	}
+
+	static void append(value_container& x, const value_container& y)
+	{
+		x.unite(y);
+	}
+
+	template<typename other_value_container>
+	static void append(value_container& x, const other_value_container& y)
+	{
+		for (auto p = y.begin(); p != y.end(); ++p)
+			add(x, *p);
+	}
+protected:
+	~bitset_bucket_value_traits() = default;
+};
+
+} // namespace masutils
+
+#endif // MASUTILS_VALUE_DICTIONARY_H_
@@ -10,10 +10,14 @@
 #include <iostream>
 #include <vector>
 #include <mutex>
+#include <thread>
 #include <set>
 #include <ctime>
 #include <list>
 #include <functional>
+#include <fstream>
+#include <numeric>
+#include <algorithm>
 
 #include <iosfwd>
 #include <cstring>
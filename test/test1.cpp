@@ -2,8 +2,22 @@
 
 #include "../include/buckets.h"
 #include "../include/buckets_supp.h"
+#include "../include/buckets_algo.h"
+#include "../include/boundary_search.h"
+#include "../include/frozen_buckets.h"
+#include "../include/value_dictionary.h"
+#include "../include/dense_buckets.h"
+#include "../include/numeric_buckets.h"
+#include "../include/bucket_stats.h"
+#include "../include/durable_buckets.h"
+#include "../include/segmented_buckets.h"
+#include "../include/rollup_pyramid.h"
+#include "../include/recurring_buckets.h"
+#include "../include/sweep_cursor.h"
 #include "../include/app/main_support.h"
 #include "../include/test/support.h"
+#include "../include/test/workload.h"
+#include "../include/test/search_check.h"
 
 using namespace masutils;
 using namespace mastest;
@@ -405,3 +419,1625 @@ TEST(BucketTest, SpreadBucketIntoAnother) {
 		}
 	}
 }
+
+TEST(BucketAlgoTest, OverlapJoin) {
+	using StaffBucket   = buckets<int, int>;
+	using MachineBucket = buckets<int, const char*, compare_traits<int>, unique_bucket_value_traits<const char*>>;
+
+	StaffBucket staff;
+	staff.spread( 4, 10, 1);
+	staff.spread( 7, 14, 2);
+	staff.spread(20, 30, 3);
+
+	MachineBucket machines;
+	machines.spread( 0,  5, "oven");
+	machines.spread( 8, 12, "mixer");
+	machines.spread(14, 20, "idle");
+	machines.spread(25, 40, "oven");
+
+	std::vector<triplet<int, int, std::size_t>> fragments;
+	const int count = overlap_join(staff, machines,
+		[&fragments](int low, int high, const StaffBucket::value_container& left, const MachineBucket::value_container& right) {
+			fragments.push_back({ low, high, left.size() * 10 + right.size() });
+		});
+
+	ASSERT_EQ(count, 4) << "four overlapping fragments";
+	ASSERT_EQ(fragments.size(), 4);
+
+	const int expected[4][3] = {
+		{  4,  5, 11 },
+		{  8, 10, 21 },
+		{ 10, 12, 11 },
+		{ 25, 30, 11 }
+	};
+	for (std::size_t i = 0; i < 4; ++i) {
+		EXPECT_EQ(fragments[i].first,  expected[i][0]) << "fragment " << i;
+		EXPECT_EQ(fragments[i].second, expected[i][1]) << "fragment " << i;
+		EXPECT_EQ(fragments[i].third,  std::size_t(expected[i][2])) << "fragment " << i;
+	}
+
+	StaffBucket empty;
+	EXPECT_EQ(overlap_join(staff, empty, [](int, int, const StaffBucket::value_container&, const StaffBucket::value_container&) {}), 0)
+		<< "nothing overlaps an empty bucket";
+}
+
+TEST(BucketAlgoTest, CoverageAlgebra) {
+	using TestBucket = buckets<int, int>;
+
+	TestBucket a;
+	a.spread( 0, 10, 1);
+	a.spread( 5, 15, 2); // touches, joins into one extent 0-15
+	a.spread(20, 30, 3);
+	a.spread(40, 50, 4);
+
+	TestBucket b;
+	b.spread(10, 25, 5);
+	b.spread(30, 40, 6);
+	b.spread(60, 70, 7);
+
+	using extent = std::pair<int, int>;
+
+	{
+		coverage_list<int> out;
+		EXPECT_EQ(coverage_union(a, b, out), 2);
+		EXPECT_EQ(out, (coverage_list<int>{ extent(0, 50), extent(60, 70) })) << "union joins touching extents";
+	}
+
+	{
+		coverage_list<int> out;
+		EXPECT_EQ(coverage_intersection(a, b, out), 2);
+		EXPECT_EQ(out, (coverage_list<int>{ extent(10, 15), extent(20, 25) }));
+	}
+
+	{
+		coverage_list<int> out;
+		EXPECT_EQ(coverage_difference(a, b, out), 3);
+		EXPECT_EQ(out, (coverage_list<int>{ extent(0, 10), extent(25, 30), extent(40, 50) }));
+	}
+
+	{
+		coverage_list<int> out;
+		EXPECT_EQ(coverage_difference(b, a, out), 3);
+		EXPECT_EQ(out, (coverage_list<int>{ extent(15, 20), extent(30, 40), extent(60, 70) }));
+	}
+
+	{
+		TestBucket empty;
+		coverage_list<int> out;
+		EXPECT_EQ(coverage_intersection(a, empty, out), 0) << "nothing intersects an empty bucket";
+		EXPECT_EQ(coverage_union(empty, b, out), 3) << "union with an empty bucket is the coverage of the other";
+	}
+}
+
+TEST(BucketTest, FindAndFindBatch) {
+	using TestBucket = buckets<int, int>;
+
+	TestBucket bucket;
+	bucket.spread( 9, 10, 1);
+	bucket.spread(10, 25, 2);
+	bucket.spread(30, 40, 3);
+	bucket.spread(50, 60, 4);
+
+	EXPECT_TRUE(bucket.find(8) == bucket.end()) << "before the first bucket";
+	EXPECT_EQ(bucket.find(9)->first, 9) << "low bound is inside the bucket";
+	EXPECT_EQ(bucket.find(10)->first, 10) << "high bound belongs to the next bucket";
+	EXPECT_TRUE(bucket.find(25) == bucket.end()) << "high bound of a bucket followed by a gap";
+	EXPECT_EQ(bucket.find(59)->first, 50);
+	EXPECT_TRUE(bucket.find(60) == bucket.end()) << "after the last bucket";
+
+	const std::vector<int> points = { 55, 9, 27, 30, 100, 24, 9, 10 };
+	std::vector<TestBucket::const_iterator> found;
+	EXPECT_EQ(bucket.find_batch(points, found), 6) << "two of the points fall outside of the buckets";
+	ASSERT_EQ(found.size(), points.size());
+
+	const TestBucket& const_bucket = bucket;
+	for (std::size_t i = 0; i < points.size(); ++i) {
+		EXPECT_TRUE(found[i] == const_bucket.find(points[i])) << "batch and single lookup agree for point " << points[i];
+	}
+
+	const std::vector<int> sorted_points = { 0, 9, 15, 35, 45, 59 };
+	EXPECT_EQ(bucket.find_batch(sorted_points, found), 4) << "already sorted points";
+	EXPECT_TRUE(found[0] == const_bucket.end());
+	EXPECT_EQ(found[3]->first, 30);
+}
+
+TEST(BoundarySearchTest, MatchesUpperBound) {
+	struct modulo_traits : public compare_traits<int> {
+		static bool lt(const int& x, const int& y) noexcept { return (x % 1000) < (y % 1000); }
+	};
+
+	static_assert(boundary_search<compare_traits<int>, int>::vectorized, "ascending int is vectorized");
+	static_assert(boundary_search<compare_traits_descending<time_t>, time_t>::vectorized, "descending time_t is vectorized");
+	static_assert(!boundary_search<modulo_traits, int>::vectorized, "custom traits use the generic search");
+	static_assert(!boundary_search<compare_traits<double>, double>::vectorized, "floating point uses the generic search");
+
+	std::vector<int> ascending;
+	std::vector<time_t> descending;
+	for (int i = 0; i < 1000; ++i) {
+		ascending.push_back(i * 3 - 500);
+		descending.push_back(time_t(10000) - i * 7);
+	}
+
+	for (int key = -600; key < 2700; key += 1) {
+		for (std::size_t n : { std::size_t(0), std::size_t(1), std::size_t(17), std::size_t(64), std::size_t(65), ascending.size() }) {
+			const std::size_t expected = std::upper_bound(ascending.begin(), ascending.begin() + n, key) - ascending.begin();
+			ASSERT_EQ(search_upper_bound<compare_traits<int>>(ascending.data(), n, key), expected) << "key " << key << " n " << n;
+		}
+	}
+
+	for (time_t key = 2000; key < 10100; key += 3) {
+		const std::size_t expected = std::upper_bound(descending.begin(), descending.end(), key, std::greater<time_t>()) - descending.begin();
+		ASSERT_EQ(search_upper_bound<compare_traits_descending<time_t>>(descending.data(), descending.size(), key), expected) << "key " << key;
+	}
+
+	const std::vector<int> modulo = { 2001, 1002, 3, 504, 1999 };
+	EXPECT_EQ(search_upper_bound<modulo_traits>(modulo.data(), modulo.size(), 4), 3u) << "custom ordering is respected";
+}
+
+// Both bounds of every search this translation unit is compiled with; the
+// same checks are run with AVX2 enabled by test_avx2.cpp.
+TEST(BoundarySearchTest, MatchesStdOnRandomData) {
+	EXPECT_EQ((check_boundary_search<compare_traits<int>>(1, 300, -1000, 1, std::less<int>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits_descending<int>>(2, 300, -1000, 3, std::greater<int>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits<long long>>(3, 300, -1000LL, 1LL << 33, std::less<long long>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits_descending<time_t>>(4, 300, time_t(1700000000), time_t(60), std::greater<time_t>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits<unsigned>>(5, 300, 1u, 5u, std::less<unsigned>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits<double>>(6, 100, -10.0, 0.5, std::less<double>())), "") << "generic search";
+}
+
+TEST(FrozenBucketTest, FreezeKeepsBucketsAndValues) {
+	using TestBucket   = buckets<int, int>;
+	using FrozenBucket = frozen_buckets<int, int, compare_traits<int>, bucket_value_traits<int>>;
+
+	TestBucket bucket;
+	bucket.spread( 9, 10, 1);
+	bucket.spread(10, 25, 2);
+	bucket.spread(30, 40, 3);
+	bucket.spread(30, 31, 4);
+	bucket.spread(50, 60, 5);
+	bucket.spread(59, 60, 6);
+	bucket.spread(15, 55, 9);
+
+	const FrozenBucket frozen = bucket.freeze();
+
+	EXPECT_EQ(frozen.size(), bucket.size()) << "same number of buckets";
+	{
+		mastest::bucket_compare<FrozenBucket>::instance_list difference_list;
+		EXPECT_TRUE(
+			bucket_compare<FrozenBucket>::equal(frozen, {
+				{  9, 10, { 1 } },
+				{ 10, 15, { 2 } },
+				{ 15, 25, { 2, 9 } },
+				{ 25, 30, { 9 } },
+				{ 30, 31, { 3, 4, 9 } },
+				{ 31, 40, { 3, 9 } },
+				{ 40, 50, { 9 } },
+				{ 50, 55, { 5, 9 } },
+				{ 55, 59, { 5 } },
+				{ 59, 60, { 5, 6 } }
+			}, difference_list)
+		) << "frozen bucket has the same buckets and values" << std::endl << "failed: " << difference_list;
+	}
+
+	const TestBucket& const_bucket = bucket;
+	for (int index = 0; index < 70; ++index) {
+		auto f = frozen.find(index);
+		auto b = const_bucket.find(index);
+		ASSERT_EQ(f == frozen.end(), b == const_bucket.end()) << "index " << index;
+		if (b != const_bucket.end()) {
+			EXPECT_EQ(f->first, b->first) << "index " << index;
+			EXPECT_EQ(f->third.size(), b->third.size()) << "index " << index;
+		}
+	}
+
+	{
+		std::vector<int> lows;
+		for (auto p = frozen.beginRange(26, 52); p != frozen.endRange(26, 52); ++p)
+			lows.push_back(p->first);
+		EXPECT_EQ(lows, (std::vector<int>{ 25, 30, 31, 40 })) << "like buckets, the bucket holding 52 ends the range";
+	}
+
+	{
+		std::vector<int> lows;
+		for (auto p = frozen.beginRange(25, 30); p != frozen.endRange(25, 30); ++p)
+			lows.push_back(p->first);
+		EXPECT_EQ(lows, (std::vector<int>{ 15 })) << "a bucket ending at start_range is in the range";
+	}
+
+	{
+		std::vector<int> lows;
+		for (auto p = frozen.beginRange(61, 70); p != frozen.endRange(61, 70); ++p)
+			lows.push_back(p->first);
+		EXPECT_TRUE(lows.empty()) << "nothing after the last bucket";
+	}
+}
+
+TEST(FrozenBucketTest, RangeMatchesBuckets) {
+	using TestBucket   = buckets<int, int>;
+	using FrozenBucket = frozen_buckets<int, int, compare_traits<int>, bucket_value_traits<int>>;
+
+	// the lows of the buckets from beginRange to endRange
+	auto range_of = [](const FrozenBucket& frozen, int low, int high) {
+		std::vector<int> lows;
+		for (auto p = frozen.beginRange(low, high); p != frozen.endRange(low, high); ++p)
+			lows.push_back(p->first);
+		return lows;
+	};
+	auto bucket_range_of = [](TestBucket& bucket, int low, int high) {
+		std::vector<int> lows;
+		for (auto p = bucket.beginRange<false>(low, high); p != bucket.endRange<false>(low, high); ++p)
+			lows.push_back(p->first);
+		return lows;
+	};
+
+	unsigned seed = 1618;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int round = 0; round < 30; ++round) {
+		TestBucket bucket(0, 500);
+		for (int i = 0; i < 5 + next(40); ++i) {
+			const int l = next(500);
+			bucket.spread(l, l + 1 + next(60), i);
+		}
+		const FrozenBucket full = bucket.freeze();
+		const FrozenBucket relative = bucket.freeze(boundary_encoding::relative32);
+
+		for (int i = 0; i < 200; ++i) {
+			const int low = next(560) - 30;
+			const int high = low + next(120);
+			const std::vector<int> expected = bucket_range_of(bucket, low, high);
+			ASSERT_EQ(range_of(full, low, high), expected) << "round " << round << " range " << low << " to " << high;
+			ASSERT_EQ(range_of(relative, low, high), expected) << "round " << round << " range " << low << " to " << high;
+		}
+	}
+}
+
+TEST(SmallVectorTest, InlineThenHeap) {
+	small_vector<std::string, 2> values;
+	EXPECT_TRUE(values.empty());
+	EXPECT_TRUE(values.is_inline());
+
+	values.push_back("one");
+	values.push_back("two");
+	EXPECT_TRUE(values.is_inline()) << "two values fit inline";
+
+	values.push_back(values.front()); // value aliases the container while it grows
+	EXPECT_FALSE(values.is_inline()) << "third value moves the values to the heap";
+	EXPECT_EQ(values.size(), 3u);
+	EXPECT_EQ(values[2], "one");
+
+	const std::vector<std::string> more = { "x", "y" };
+	values.insert(values.begin() + 1, more.begin(), more.end());
+	EXPECT_EQ(std::vector<std::string>(values.begin(), values.end()), (std::vector<std::string>{ "one", "x", "y", "two", "one" }));
+
+	small_vector<std::string, 2> copy(values);
+	EXPECT_TRUE(copy == values);
+
+	small_vector<std::string, 2> moved(std::move(copy));
+	EXPECT_TRUE(moved == values);
+	EXPECT_TRUE(copy.empty()) << "moved from vector is empty";
+
+	small_vector<std::string, 2> small = { "a" };
+	small_vector<std::string, 2> small_moved(std::move(small));
+	EXPECT_TRUE(small_moved.is_inline());
+	EXPECT_EQ(small_moved.front(), "a");
+
+	values.erase(values.begin(), values.begin() + 3);
+	EXPECT_EQ(std::vector<std::string>(values.begin(), values.end()), (std::vector<std::string>{ "two", "one" }));
+}
+
+TEST(SmallVectorTest, DefaultValueContainersStayInline) {
+	using TestBucket = buckets<int, const char*>;
+	using AddBucket  = buckets<int, int, compare_traits<int>, bucket_value_add_traits<int>>;
+
+	TestBucket bucket;
+	bucket.spread(0, 10, "a");
+	bucket.spread(5, 15, "b");
+	for (auto p = bucket.begin(); p != bucket.end(); ++p) {
+		EXPECT_TRUE(p->third.is_inline()) << "one or two values are kept inline";
+	}
+
+	AddBucket add_bucket;
+	add_bucket.spread(0, 10, 1);
+	add_bucket.spread(5, 15, 2);
+	add_bucket.spread(0, 15, 3);
+	for (auto p = add_bucket.begin(); p != add_bucket.end(); ++p) {
+		EXPECT_EQ(p->third.size(), 1u) << "running total is a single value";
+		EXPECT_TRUE(p->third.is_inline());
+	}
+	EXPECT_EQ(add_bucket.begin()->third.front(), 4);
+
+	using ListBucket = buckets<int, int, compare_traits<int>, list_bucket_value_traits<int>>;
+	static_assert(std::is_same<ListBucket::value_container, std::list<int>>::value, "list containers are still available");
+	ListBucket list_bucket;
+	list_bucket.spread(0, 10, 1);
+	list_bucket.spread(5, 15, 2);
+	EXPECT_EQ(std::next(list_bucket.begin())->third, std::list<int>({ 1, 2 }));
+}
+
+TEST(BitsetValueTest, MatchesUniqueValues) {
+	using UniqueBucket = buckets<int, std::string, compare_traits<int>, unique_bucket_value_traits<std::string>>;
+	using BitsetBucket = buckets<int, std::string, compare_traits<int>, bitset_bucket_value_traits<std::string>>;
+
+	UniqueBucket unique_bucket;
+	BitsetBucket bitset_bucket;
+
+	auto both = [&](int low, int high, const std::string& value) {
+		unique_bucket.spread(low, high, value);
+		bitset_bucket.spread(low, high, value);
+	};
+
+	for (int i = 0; i < 200; ++i) {
+		both(i, i + 50, "employee" + std::to_string(i % 150));
+	}
+	both(0, 300, "manager");
+	both(10, 20, "employee3");
+
+	ASSERT_EQ(bitset_bucket.size(), unique_bucket.size()) << "same buckets";
+
+	auto u = unique_bucket.begin();
+	for (auto b = bitset_bucket.begin(); b != bitset_bucket.end(); ++b, ++u) {
+		EXPECT_EQ(b->first, u->first);
+		EXPECT_EQ(b->second, u->second);
+		EXPECT_EQ(b->third.size(), u->third.size()) << "bucket " << b->first;
+		std::set<std::string> values(b->third.begin(), b->third.end());
+		EXPECT_TRUE(values == u->third) << "bucket " << b->first;
+	}
+
+	const BitsetBucket::value_container& first = bitset_bucket.begin()->third;
+	EXPECT_TRUE(first.contains("manager"));
+	EXPECT_FALSE(first.contains("employee199")) << "only added to later buckets";
+	EXPECT_FALSE(first.contains("nobody")) << "never interned";
+
+	value_bitset<std::string> x, y;
+	x.insert("employee1");
+	x.insert("employee140");
+	y.insert("employee140");
+	EXPECT_FALSE(x == y);
+	y.unite(x);
+	EXPECT_TRUE(x == y) << "same values, same words";
+
+	value_dictionary<std::string> other;
+	value_bitset<std::string> z(other);
+	z.insert("employee1");
+	EXPECT_THROW(z.unite(x), std::invalid_argument) << "ids of another dictionary";
+
+	// values are read while another thread keeps interning
+	value_dictionary<int> numbers;
+	for (int i = 0; i < 100; ++i)
+		numbers.intern(i);
+	std::thread writer([&numbers] {
+		for (int i = 100; i < 20000; ++i)
+			numbers.intern(i);
+	});
+	for (int round = 0; round < 200; ++round)
+		for (value_dictionary<int>::id_type id = 0; id < 100; ++id)
+			ASSERT_EQ(numbers.value(id), static_cast<int>(id));
+	writer.join();
+	EXPECT_EQ(numbers.size(), 20000u);
+	EXPECT_EQ(numbers.value(19999), 19999);
+	EXPECT_EQ(numbers.value(64), 64) << "first id of the second chunk";
+}
+
+TEST(StringPoolTest, InternedGlossaryMatchesStringGlossary) {
+	using StringGlossary   = glossary<char, std::basic_string<char>, caseInsensitiveLess<std::basic_string<char>>>;
+	using InternedGlossary = interned_glossary<char, caseInsensitiveLess<interned_string<char>>>;
+
+	const std::vector<const char*> words = { "March", "mango", "apple", "Apricot", "aPricot", "banana", "Mango" };
+
+	StringGlossary string_glossary;
+	InternedGlossary interned;
+	for (auto word : words) {
+		string_glossary.add(word);
+		interned.add(word);
+	}
+
+	ASSERT_EQ(interned.size(), string_glossary.size());
+	auto s = string_glossary.begin();
+	for (auto i = interned.begin(); i != interned.end(); ++i, ++s) {
+		EXPECT_EQ(i->first, s->first);
+		ASSERT_EQ(i->third.size(), s->third.size()) << "bucket " << i->first;
+		auto sv = s->third.begin();
+		for (auto iv = i->third.begin(); iv != i->third.end(); ++iv, ++sv) {
+			EXPECT_EQ(iv->str(), *sv);
+		}
+	}
+
+	interned_string<char> x("Apricot"), y(std::string("Apricot"));
+	EXPECT_TRUE(x == y) << "same word, same pool entry";
+	EXPECT_EQ(x.c_str(), y.c_str()) << "stored once";
+	EXPECT_EQ(x.folded(), "apricot");
+
+	// characters with the high bit set order the same way in both
+	const std::vector<std::string> accented = { "\xe9t\xe9", "\xc9T\xc9", "ete", "Zebra", "apple", "\x7f" };
+	caseInsensitiveLess<std::string> string_less;
+	caseInsensitiveLess<interned_string<char>> interned_less;
+	for (const auto& a : accented) {
+		for (const auto& b : accented) {
+			EXPECT_EQ(interned_less(interned_string<char>(a), interned_string<char>(b)), string_less(a, b))
+				<< "\"" << a << "\" < \"" << b << "\"";
+		}
+	}
+}
+
+TEST(DenseBucketTest, MatchesBuckets) {
+	using ListBucket  = buckets<int, int>;
+	using DenseBucket = dense_buckets<int, int>;
+
+	auto same = [](const DenseBucket& dense, const ListBucket& list) {
+		if (dense.size() != list.size())
+			return false;
+		auto l = list.begin();
+		for (auto d = dense.begin(); d != dense.end(); ++d, ++l) {
+			if (d->first != l->first || d->second != l->second)
+				return false;
+			if (!std::equal(d->third.begin(), d->third.end(), l->third.begin(), l->third.end()))
+				return false;
+		}
+		return l == list.end();
+	};
+
+	ListBucket list(26, 1440);
+	DenseBucket dense(26, 1440);
+
+	unsigned seed = 12345;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int i = 0; i < 300; ++i) {
+		const int low  = next(1500) - 20;
+		const int high = low + next(200);
+		if (next(5) == 0) {
+			EXPECT_EQ(dense.cover(low, high, i), list.cover(low, high, i)) << "cover " << low << "-" << high;
+		}
+		else {
+			EXPECT_EQ(dense.spread(low, high, i), list.spread(low, high, i)) << "spread " << low << "-" << high;
+		}
+		ASSERT_TRUE(same(dense, list)) << "after operation " << i;
+	}
+
+	const ListBucket& const_list = list;
+	for (int index = 0; index < 1500; ++index) {
+		auto d = dense.find(index);
+		auto l = const_list.find(index);
+		ASSERT_EQ(d == dense.end(), l == const_list.end()) << "index " << index;
+		if (l != const_list.end()) {
+			EXPECT_EQ(d->first, l->first);
+			EXPECT_EQ(d->second, l->second);
+		}
+	}
+
+	EXPECT_THROW((DenseBucket(0, 1 << 24)), std::length_error) << "range too large for a lookup table";
+
+	dense_buckets<char, int> unconstrained;
+	EXPECT_EQ(unconstrained.spread('a', 'd', 1), 1);
+	EXPECT_EQ(unconstrained.spread('b', 'c', 2), 1);
+	EXPECT_EQ(unconstrained.size(), 3u);
+	EXPECT_EQ(unconstrained.find('b')->third.size(), 2u);
+}
+
+TEST(FrozenBucketTest, RelativeBoundaryEncoding) {
+	using TimeBucket = buckets<time_t, int>;
+	using DescendingBucket = buckets<time_t, int, compare_traits_descending<time_t>>;
+
+	const time_t day = 1700000000;
+	TimeBucket bucket(day, day + 24 * 60 * 60);
+	DescendingBucket descending(day + 24 * 60 * 60, day);
+	for (int i = 0; i < 200; ++i) {
+		bucket.spread(day + i * 400, day + i * 400 + 300, i);
+		descending.spread(day + i * 400 + 300, day + i * 400, i);
+	}
+
+	const auto full     = bucket.freeze();
+	const auto relative = bucket.freeze(boundary_encoding::relative32);
+	const auto full_descending = descending.freeze();
+	const auto relative_descending = descending.freeze(boundary_encoding::relative32);
+
+	EXPECT_EQ(full.encoding(), boundary_encoding::full);
+	EXPECT_EQ(relative.encoding(), boundary_encoding::relative32) << "a day fits in 32 bit offsets";
+	EXPECT_EQ(relative_descending.encoding(), boundary_encoding::relative32);
+
+	for (time_t t = day - 1000; t < day + 24 * 60 * 60 + 1000; t += 7) {
+		auto f = full.find(t);
+		auto r = relative.find(t);
+		ASSERT_EQ(f == full.end(), r == relative.end()) << "time " << t;
+		if (f != full.end()) {
+			EXPECT_EQ(f->first, r->first) << "time " << t;
+		}
+		auto fd = full_descending.find(t);
+		auto rd = relative_descending.find(t);
+		ASSERT_EQ(fd == full_descending.end(), rd == relative_descending.end()) << "time " << t;
+		if (fd != full_descending.end()) {
+			EXPECT_EQ(fd->first, rd->first) << "time " << t;
+		}
+	}
+
+	EXPECT_EQ(std::distance(relative.beginRange(day + 1000, day + 2000), relative.endRange(day + 1000, day + 2000)),
+	          std::distance(full.beginRange(day + 1000, day + 2000), full.endRange(day + 1000, day + 2000)));
+
+	TimeBucket unconstrained;
+	unconstrained.spread(day, day + 10, 1);
+	EXPECT_EQ(unconstrained.freeze(boundary_encoding::relative32).encoding(), boundary_encoding::full)
+		<< "unconstrained buckets keep full width boundaries";
+
+	TimeBucket wide(0, time_t(1) << 40);
+	wide.spread(5, 10, 1);
+	EXPECT_EQ(wide.freeze(boundary_encoding::relative32).encoding(), boundary_encoding::full)
+		<< "range too wide for 32 bit offsets";
+}
+
+TEST(NumericBucketTest, MatchesAddTraits) {
+	using AddBucket     = buckets<int, double, compare_traits<int>, bucket_value_add_traits<double>>;
+	using NumericBucket = numeric_buckets<int, double>;
+	using DescendingAddBucket     = buckets<int, int, compare_traits_descending<int>, bucket_value_add_traits<int>>;
+	using DescendingNumericBucket = numeric_buckets<int, int, compare_traits_descending<int>>;
+
+	auto same = [](const auto& numeric, const auto& list) {
+		if (numeric.size() != list.size())
+			return false;
+		auto l = list.begin();
+		for (auto n = numeric.begin(); n != numeric.end(); ++n, ++l) {
+			if (n->first != l->first || n->second != l->second)
+				return false;
+			if (l->third.size() != 1 || n->third != l->third.front())
+				return false;
+		}
+		return true;
+	};
+
+	AddBucket list(26, 1440);
+	NumericBucket numeric(26, 1440);
+	DescendingAddBucket descending_list;
+	DescendingNumericBucket descending_numeric;
+
+	unsigned seed = 54321;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int i = 0; i < 300; ++i) {
+		const int low  = next(1500) - 20;
+		const int high = low + next(200);
+		const double value = 0.1 * next(100);
+		if (next(5) == 0) {
+			EXPECT_EQ(numeric.cover(low, high, value), list.cover(low, high, value)) << "cover " << low << "-" << high;
+			EXPECT_EQ(descending_numeric.cover(high, low, i), descending_list.cover(high, low, i));
+		}
+		else {
+			EXPECT_EQ(numeric.spread(low, high, value), list.spread(low, high, value)) << "spread " << low << "-" << high;
+			EXPECT_EQ(descending_numeric.spread(high, low, i), descending_list.spread(high, low, i));
+		}
+		ASSERT_TRUE(same(numeric, list)) << "after operation " << i;
+		ASSERT_TRUE(same(descending_numeric, descending_list)) << "after operation " << i;
+	}
+
+	double total = 0, largest = 0, weighted = 0, covered = 0;
+	for (auto p = list.begin(); p != list.end(); ++p) {
+		total += p->third.front();
+		largest = std::max(largest, p->third.front());
+		weighted += p->third.front() * (p->second - p->first);
+		covered += p->second - p->first;
+	}
+	EXPECT_DOUBLE_EQ(numeric.sum(), total);
+	EXPECT_EQ(numeric.max_sum(), largest);
+	EXPECT_DOUBLE_EQ(numeric.weighted_sum(), weighted);
+	EXPECT_DOUBLE_EQ(numeric.weighted_average(), weighted / covered);
+
+	const AddBucket& const_list = list;
+	for (int index = 0; index < 1500; ++index) {
+		auto n = numeric.find(index);
+		auto l = const_list.find(index);
+		ASSERT_EQ(n == numeric.end(), l == const_list.end()) << "index " << index;
+		if (l != const_list.end()) {
+			EXPECT_EQ(n->first, l->first);
+		}
+	}
+
+	// widths of billions of seconds with int sums: nothing is accumulated
+	// in int, neither the widths nor the products
+	numeric_buckets<long long, int> seconds;
+	seconds.spread(0, 3000000000LL, 2);
+	seconds.spread(3000000000LL, 4000000000LL, 5);
+	EXPECT_EQ(seconds.weighted_sum<long long>(), 11000000000LL);
+	EXPECT_DOUBLE_EQ(seconds.weighted_average(), 2.75);
+	EXPECT_EQ(seconds.max_sum(), 5);
+}
+
+TEST(BucketTest, HintedAndCursorEdits) {
+	using TestBucket = buckets<int, int>;
+
+	auto same = [](const TestBucket& x, const TestBucket& y) {
+		return std::equal(x.begin(), x.end(), y.begin(), y.end(),
+			[](const TestBucket::triplet_type& a, const TestBucket::triplet_type& b) {
+				return a.first == b.first && a.second == b.second && a.third == b.third;
+			});
+	};
+
+	TestBucket plain(0, 10000);
+	TestBucket hinted(0, 10000);
+	TestBucket cursored(0, 10000);
+	TestBucket::cursor cursor(cursored);
+
+	unsigned seed = 2024;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	// a burst of edits which wander around, with the odd jump
+	int at = 5000;
+	for (int i = 0; i < 400; ++i) {
+		at = (next(20) == 0) ? next(10000) : at + next(60) - 30;
+		const int low  = at;
+		const int high = at + 1 + next(40);
+
+		// any iterator is a valid hint, a good one just makes it faster
+		auto hint = hinted.begin();
+		std::advance(hint, next(static_cast<int>(hinted.size()) + 1));
+
+		if (next(6) == 0) {
+			const int expected = plain.cover(low, high, i);
+			EXPECT_EQ(hinted.cover(hint, low, high, i), expected);
+			EXPECT_EQ(cursor.cover(low, high, i), expected);
+		}
+		else {
+			const int expected = plain.spread(low, high, i);
+			EXPECT_EQ(hinted.spread(hint, low, high, i), expected);
+			EXPECT_EQ(cursor.spread(low, high, i), expected);
+		}
+		ASSERT_TRUE(same(plain, hinted)) << "after operation " << i;
+		ASSERT_TRUE(same(plain, cursored)) << "after operation " << i;
+		EXPECT_EQ(cursor.position()->first, std::max(low, 0)) << "the cursor is left at the edit";
+	}
+}
+
+TEST(BucketTest, EditResult) {
+	using TestBucket = buckets<int, int>;
+
+	TestBucket bucket(0, 100);
+	TestBucket::edit_result result;
+
+	EXPECT_EQ(bucket.spread(10, 50, 1, result), 1);
+	EXPECT_EQ(result.splits, 0) << "nothing to split in an empty bucket";
+	ASSERT_EQ(std::distance(result.first, result.last), 1);
+	EXPECT_EQ(result.first->first, 10);
+	EXPECT_EQ(result.first->second, 50);
+
+	// splits [10, 50) at 20, and fills the gap [50, 60)
+	EXPECT_EQ(bucket.spread(20, 60, 2, result), 2);
+	EXPECT_EQ(result.splits, 1);
+	ASSERT_EQ(std::distance(result.first, result.last), 2);
+	EXPECT_EQ(result.first->first, 20);
+	EXPECT_EQ(std::next(result.first)->second, 60);
+
+	EXPECT_EQ(bucket.spread(30, 40, 3, result), 1);
+	EXPECT_EQ(result.splits, 2) << "[20, 50) is split in three";
+	EXPECT_EQ(result.first->first, 30);
+	EXPECT_EQ(result.first->third.size(), 3u);
+
+	for (auto p = result.first; p != result.last; ++p)
+		EXPECT_EQ(p->third.back(), 3) << "the range holds the buckets the value was added to";
+
+	EXPECT_EQ(bucket.cover(15, 45, 4, result), 1);
+	EXPECT_EQ(result.splits, 2) << "[10, 20) is split at 15 and [40, 50) at 45";
+	ASSERT_EQ(std::distance(result.first, result.last), 1);
+	EXPECT_EQ(result.first->first, 15);
+	EXPECT_EQ(result.first->second, 45);
+	EXPECT_EQ(result.last->first, 45);
+
+	EXPECT_EQ(bucket.spread(200, 300, 5, result), 0);
+	EXPECT_TRUE(result.first == bucket.end() && result.last == bucket.end());
+}
+
+TEST(BucketTest, BatchRollbackAndCommit) {
+	using TestBucket = buckets<int, int>;
+	using Snapshot = std::vector<std::tuple<int, int, std::vector<int>>>;
+
+	auto snapshot = [](const TestBucket& bucket) {
+		Snapshot result;
+		for (auto p = bucket.begin(); p != bucket.end(); ++p)
+			result.emplace_back(p->first, p->second, std::vector<int>(p->third.begin(), p->third.end()));
+		return result;
+	};
+
+	unsigned seed = 777;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket bucket(0, 1000);
+	TestBucket plain(0, 1000);
+	for (int i = 0; i < 50; ++i) {
+		const int low  = next(1000);
+		const int high = low + next(100);
+		bucket.spread(low, high, i);
+		plain.spread(low, high, i);
+	}
+
+	EXPECT_THROW(bucket.commit(), std::logic_error) << "no batch is open";
+	EXPECT_THROW(bucket.rollback(), std::logic_error) << "no batch is open";
+
+	for (int round = 0; round < 20; ++round) {
+		const Snapshot before = snapshot(bucket);
+		auto kept = bucket.begin();
+		std::advance(kept, next(static_cast<int>(bucket.size())));
+		const auto kept_first = kept->first;
+
+		std::vector<std::pair<bool, std::tuple<int, int, int>>> edits;
+		bucket.begin_batch();
+		EXPECT_TRUE(bucket.in_batch());
+		EXPECT_THROW(bucket.begin_batch(), std::logic_error) << "batches do not nest";
+		for (int i = 0; i < 10; ++i) {
+			const int low  = next(1100) - 50;
+			const int high = low + next(150);
+			const bool cover = next(4) == 0;
+			edits.emplace_back(cover, std::make_tuple(low, high, 1000 * round + i));
+			if (cover)
+				bucket.cover(low, high, 1000 * round + i);
+			else
+				bucket.spread(low, high, 1000 * round + i);
+		}
+
+		if (round % 2 == 0) {
+			bucket.rollback();
+			EXPECT_EQ(snapshot(bucket), before) << "round " << round;
+			EXPECT_EQ(kept->first, kept_first) << "iterators to the original buckets stay valid";
+		}
+		else {
+			bucket.commit();
+			for (const auto& edit : edits) {
+				if (edit.first)
+					plain.cover(std::get<0>(edit.second), std::get<1>(edit.second), std::get<2>(edit.second));
+				else
+					plain.spread(std::get<0>(edit.second), std::get<1>(edit.second), std::get<2>(edit.second));
+			}
+		}
+		EXPECT_FALSE(bucket.in_batch());
+	}
+
+	EXPECT_EQ(snapshot(bucket), snapshot(plain)) << "committed batches are the same as the plain edits";
+}
+
+TEST(BucketTest, CursorAfterRollback) {
+	using TestBucket = buckets<int, int>;
+
+	TestBucket bucket;
+	bucket.spread(0, 100, 1);
+	TestBucket::cursor cursor(bucket);
+
+	bucket.begin_batch();
+	cursor.spread(40, 50, 2);
+	bucket.rollback();
+	ASSERT_EQ(bucket.size(), 1u);
+	EXPECT_EQ(bucket.begin()->third.size(), 1u) << "the appended value is cut off again";
+
+	// the bucket the cursor was left on is gone; it must start over
+	EXPECT_EQ(cursor.spread(45, 47, 3), 1);
+	ASSERT_EQ(bucket.size(), 3u);
+	EXPECT_EQ(std::next(bucket.begin())->first, 45);
+	EXPECT_EQ(std::next(bucket.begin())->third.size(), 2u);
+
+	// containers which change in place are restored from a copy
+	using UniqueBucket = buckets<int, int, compare_traits<int>, unique_bucket_value_traits<int>>;
+	UniqueBucket unique;
+	unique.spread(0, 10, 1);
+	unique.begin_batch();
+	unique.spread(0, 10, 1);
+	unique.spread(0, 10, 2);
+	unique.rollback();
+	ASSERT_EQ(unique.size(), 1u);
+	EXPECT_EQ(unique.begin()->third, std::set<int>({ 1 }));
+}
+
+TEST(BucketTest, ObserverSeesEveryChange) {
+	using TestBucket = buckets<int, int>;
+
+	// keeps a copy of the observed bucket up to date from the events alone
+	class mirror_observer : public TestBucket::observer_type {
+	public:
+		mirror_observer() : mirror(0, 1000) {}
+
+		void split(const int&) override { splits++; }
+
+		void appended(const int& low, const int& high, const TestBucket::value_container& values) override {
+			for (int value : values)
+				mirror.spread(low, high, value);
+		}
+
+		void covered(const int& low, const int& high, const TestBucket::value_container& values) override {
+			mirror.cover(low, high, values.front());
+		}
+
+		// the batches of the bucket are replayed on the mirror
+		void batch_begun() override { mirror.begin_batch(); }
+		void committed() override { mirror.commit(); }
+
+		void rolled_back(const int& low, const int& high) override {
+			mirror.rollback();
+			rollbacks++;
+			undone_low = low;
+			undone_high = high;
+		}
+
+		TestBucket mirror;
+		int splits = 0;
+		int rollbacks = 0;
+		int undone_low = 0;
+		int undone_high = 0;
+	};
+
+	auto same = [](const TestBucket& x, const TestBucket& y) {
+		return std::equal(x.begin(), x.end(), y.begin(), y.end(),
+			[](const TestBucket::triplet_type& a, const TestBucket::triplet_type& b) {
+				return a.first == b.first && a.second == b.second && a.third == b.third;
+			});
+	};
+
+	unsigned seed = 99;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket bucket(0, 1000);
+	mirror_observer observer;
+	bucket.observe(&observer);
+	EXPECT_EQ(bucket.observer(), &observer);
+
+	int splits = 0;
+	for (int i = 0; i < 200; ++i) {
+		const int low  = next(1100) - 50;
+		const int high = low + next(150);
+		TestBucket::edit_result result;
+		if (next(5) == 0)
+			bucket.cover(low, high, i, result);
+		else
+			bucket.spread(low, high, i, result);
+		splits += result.splits;
+		ASSERT_TRUE(same(bucket, observer.mirror)) << "after operation " << i;
+	}
+	EXPECT_EQ(observer.splits, splits);
+
+	for (int i = 0; i < 20; ++i) {
+		bucket.begin_batch();
+		for (int j = next(4); j >= 0; --j) {
+			const int low = next(1000);
+			const int high = low + 1 + next(100);
+			if (next(3) == 0)
+				bucket.cover(low, high, j);
+			else
+				bucket.spread(low, high, j);
+			ASSERT_TRUE(same(bucket, observer.mirror)) << "in batch " << i;
+		}
+		if (next(2) == 0)
+			bucket.commit();
+		else
+			bucket.rollback();
+		ASSERT_TRUE(same(bucket, observer.mirror)) << "after batch " << i;
+	}
+
+	const int rollbacks = observer.rollbacks;
+	bucket.begin_batch();
+	bucket.spread(10, 20, 1);
+	bucket.cover(15, 30, 2);
+	bucket.rollback();
+	EXPECT_EQ(observer.rollbacks, rollbacks + 1);
+	EXPECT_TRUE(same(bucket, observer.mirror));
+	EXPECT_LE(observer.undone_low, 10) << "the undone range holds every change";
+	EXPECT_GE(observer.undone_high, 30);
+
+	bucket.begin_batch();
+	bucket.rollback();
+	EXPECT_EQ(observer.undone_low, observer.undone_high) << "nothing was undone";
+
+	bucket.observe(nullptr);
+	const int splits_before = observer.splits;
+	bucket.spread(505, 506, 1);
+	EXPECT_EQ(observer.splits, splits_before) << "a detached observer sees nothing";
+}
+
+TEST(BucketStatsTest, MatchesFullScan) {
+	using Stats = combined_bucket_stats<coverage_stats<int>, distinct_value_stats<int>>;
+	using TestBucket = buckets<int, int, compare_traits<int>, bucket_value_traits<int>, Stats>;
+
+	auto check = [](const TestBucket& bucket) {
+		int covered = 0;
+		std::set<int> values;
+		for (auto p = bucket.begin(); p != bucket.end(); ++p) {
+			covered += p->second - p->first;
+			values.insert(p->third.begin(), p->third.end());
+		}
+		EXPECT_EQ(bucket.stats().bucket_count(), bucket.size());
+		EXPECT_EQ(bucket.stats().covered_length(), covered);
+		EXPECT_EQ(bucket.stats().distinct_values(), values.size());
+
+		int low, high;
+		if (bucket.extent(low, high)) {
+			EXPECT_EQ(low, bucket.begin()->first);
+			EXPECT_EQ(bucket.stats().gap_length(low, high), high - low - covered);
+		}
+		return !::testing::Test::HasFailure();
+	};
+
+	unsigned seed = 4242;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket bucket(0, 1000);
+	int low, high;
+	EXPECT_FALSE(bucket.extent(low, high));
+
+	for (int i = 0; i < 200; ++i) {
+		const bool batch = next(10) == 0;
+		if (batch)
+			bucket.begin_batch();
+
+		const int l = next(1100) - 50;
+		const int h = l + next(150);
+		if (next(5) == 0)
+			bucket.cover(l, h, next(40));
+		else
+			bucket.spread(l, h, next(40));
+
+		if (batch) {
+			if (next(2) == 0)
+				bucket.rollback();
+			else
+				bucket.commit();
+		}
+		ASSERT_TRUE(check(bucket)) << "after operation " << i;
+	}
+
+	{
+		using DescendingBucket = buckets<int, int, compare_traits_descending<int>, bucket_value_traits<int>, coverage_stats<int>>;
+		DescendingBucket descending(100, 0);
+		descending.spread(90, 10, 1);
+		descending.spread(50, 40, 2);
+		EXPECT_EQ(descending.stats().covered_length(), 80);
+		EXPECT_EQ(descending.stats().bucket_count(), 3u);
+	}
+}
+
+TEST(DurableBucketTest, RecoversCheckpointAndLog) {
+	using TestBucket = buckets<int, std::string>;
+	using DurableBucket = durable_buckets<TestBucket>;
+
+	auto same = [](const TestBucket& x, const TestBucket& y) {
+		return std::equal(x.begin(), x.end(), y.begin(), y.end(),
+			[](const TestBucket::triplet_type& a, const TestBucket::triplet_type& b) {
+				return a.first == b.first && a.second == b.second && a.third == b.third;
+			});
+	};
+
+	const std::string path = ::testing::TempDir() + "durable_bucket_test";
+	std::remove((path + ".wal").c_str());
+	std::remove((path + ".ckpt").c_str());
+	std::remove((path + ".ckpt.tmp").c_str());
+
+	unsigned seed = 31337;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket plain(0, 1000);
+	{
+		// group commit every 8 edits, checkpoint every 50
+		DurableBucket durable(path, 0, 1000, 8, 50);
+		for (int i = 0; i < 120; ++i) {
+			const int low  = next(1100) - 50;
+			const int high = low + next(150);
+			const std::string value = "value " + std::to_string(i);
+			if (next(5) == 0) {
+				EXPECT_EQ(durable.cover(low, high, value), plain.cover(low, high, value));
+			}
+			else {
+				EXPECT_EQ(durable.spread(low, high, value), plain.spread(low, high, value));
+			}
+		}
+		EXPECT_EQ(durable.pending(), 4u) << "20 edits since the last checkpoint, 16 of them flushed";
+		EXPECT_TRUE(same(durable.buckets(), plain));
+	}
+
+	{
+		DurableBucket durable(path, 0, 1000);
+		EXPECT_EQ(durable.sequence(), 120u);
+		EXPECT_TRUE(same(durable.buckets(), plain)) << "checkpoint plus the log tail";
+
+		durable.spread(10, 20, "after recovery");
+		plain.spread(10, 20, "after recovery");
+		durable.flush();
+	}
+
+	{
+		// a record torn by a crash in the middle of a write is ignored
+		std::ofstream log(path + ".wal", std::ios::binary | std::ios::app);
+		ASSERT_TRUE(log.good());
+		const char torn[] = { 40, 0, 0, 0, 1, 2, 3 };
+		log.write(torn, sizeof(torn));
+		log.close();
+
+		DurableBucket durable(path, 0, 1000);
+		EXPECT_EQ(durable.sequence(), 121u);
+		EXPECT_TRUE(same(durable.buckets(), plain));
+	}
+
+	EXPECT_THROW(DurableBucket(path, 0, 500), std::runtime_error) << "checkpoint of a bucket with other constraints";
+
+	std::remove((path + ".wal").c_str());
+	std::remove((path + ".ckpt").c_str());
+}
+
+TEST(SegmentedBucketTest, SplitsAtSegmentsAndDrops) {
+	using PlainBucket = buckets<int, int>;
+	using SegmentedBucket = segmented_buckets<int, int>;
+
+	// segments of 100 starting at -50: ..., [-50, 50), [50, 150), ...
+	SegmentedBucket segmented(100, -50);
+	EXPECT_EQ(segmented.key_of(-50), 0);
+	EXPECT_EQ(segmented.key_of(-51), -1);
+	EXPECT_EQ(segmented.key_of(49), 0);
+	EXPECT_EQ(segmented.key_of(50), 1);
+
+	PlainBucket plain;
+	unsigned seed = 8080;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int i = 0; i < 200; ++i) {
+		const int low  = next(1000) - 200;
+		const int high = low + next(250);
+		if (next(5) == 0) {
+			segmented.cover(low, high, i);
+			plain.cover(low, high, i);
+		}
+		else {
+			segmented.spread(low, high, i);
+			plain.spread(low, high, i);
+		}
+	}
+
+	// every index has the same values, only the buckets are cut at the
+	// segment boundaries
+	for (int index = -250; index < 1100; ++index) {
+		std::vector<int> expected, actual;
+		const PlainBucket& const_plain = plain;
+		auto p = const_plain.find(index);
+		if (p != const_plain.end())
+			expected.assign(p->third.begin(), p->third.end());
+		segmented.find(index, [&actual](const PlainBucket::triplet_type& triplet) {
+			actual.assign(triplet.third.begin(), triplet.third.end());
+		});
+		ASSERT_EQ(actual, expected) << "index " << index;
+	}
+
+	int previous_high = -1000;
+	segmented.visit(-250, 1100, [&previous_high](const PlainBucket::triplet_type& triplet) {
+		EXPECT_LE(previous_high, triplet.first) << "visited in order";
+		EXPECT_EQ((triplet.first + 50 + 10000) / 100, (triplet.second - 1 + 50 + 10000) / 100) << "buckets stay inside a segment";
+		previous_high = triplet.second;
+	});
+
+	const std::size_t segments = segmented.segment_count();
+	auto archived = segmented.detach(160);
+	ASSERT_NE(archived, nullptr);
+	EXPECT_EQ(archived->bucket.low(), 150);
+	EXPECT_EQ(archived->bucket.high(), 250);
+	EXPECT_FALSE(segmented.find(160, [](const PlainBucket::triplet_type&) {}));
+	EXPECT_EQ(segmented.segment_count(), segments - 1);
+
+	EXPECT_EQ(segmented.drop_before(50), 3u) << "[-250, -150), [-150, -50) and [-50, 50)";
+	EXPECT_EQ(segmented.at(49), nullptr);
+	EXPECT_NE(segmented.at(50), nullptr);
+}
+
+TEST(SegmentedBucketTest, ConcurrentWritersToDifferentSegments) {
+	using SegmentedBucket = segmented_buckets<int, int>;
+
+	SegmentedBucket segmented(1000);
+	std::vector<std::thread> writers;
+	for (int t = 0; t < 4; ++t) {
+		writers.emplace_back([&segmented, t]() {
+			for (int i = 0; i < 500; ++i)
+				segmented.spread(t * 1000 + i, t * 1000 + i + 10, i);
+		});
+	}
+	for (auto& writer : writers)
+		writer.join();
+
+	EXPECT_EQ(segmented.segment_count(), 4u);
+	for (int t = 0; t < 4; ++t) {
+		std::size_t values = 0;
+		segmented.find(t * 1000 + 250, [&values](const buckets<int, int>::triplet_type& triplet) {
+			values = triplet.third.size();
+		});
+		EXPECT_EQ(values, 10u);
+	}
+}
+
+TEST(SegmentedBucketTest, SpillsAndReloadsSegments) {
+	using PlainBucket = buckets<int, std::string>;
+	using SegmentedBucket = segmented_buckets<int, std::string>;
+
+	SegmentedBucket tiered(100);
+	SegmentedBucket resident(100);
+	tiered.spill_to(::testing::TempDir(), 3);
+
+	unsigned seed = 1234;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int i = 0; i < 300; ++i) {
+		const int low  = next(2000);
+		const int high = low + next(120);
+		const std::string value = "v" + std::to_string(i);
+		if (next(5) == 0) {
+			EXPECT_EQ(tiered.cover(low, high, value), resident.cover(low, high, value));
+		}
+		else {
+			EXPECT_EQ(tiered.spread(low, high, value), resident.spread(low, high, value));
+		}
+		ASSERT_LE(tiered.resident_count(), 3u) << "after operation " << i;
+	}
+
+	EXPECT_EQ(tiered.segment_count(), resident.segment_count());
+	EXPECT_EQ(tiered.size(), resident.size()) << "spilled segments are counted without loading them";
+
+	using Triplets = std::vector<std::tuple<int, int, std::vector<std::string>>>;
+	auto collect = [](const SegmentedBucket& segmented) {
+		Triplets result;
+		segmented.visit(0, 2200, [&result](const PlainBucket::triplet_type& triplet) {
+			result.emplace_back(triplet.first, triplet.second,
+				std::vector<std::string>(triplet.third.begin(), triplet.third.end()));
+		});
+		return result;
+	};
+	EXPECT_EQ(collect(tiered), collect(resident)) << "every segment read back intact";
+	EXPECT_LE(tiered.resident_count(), 3u);
+
+	EXPECT_TRUE(tiered.drop(50)) << "dropping a spilled segment";
+	EXPECT_EQ(tiered.at(50), nullptr);
+}
+
+TEST(SegmentedBucketTest, SpillingWritersAndFailedSpills) {
+	using SegmentedBucket = segmented_buckets<int, int>;
+
+	// writers in different segments keep spilling each other's segments
+	SegmentedBucket tiered(100);
+	tiered.spill_to(::testing::TempDir(), 1);
+	std::vector<std::thread> writers;
+	for (int t = 0; t < 4; ++t) {
+		writers.emplace_back([&tiered, t]() {
+			for (int i = 0; i < 200; ++i)
+				tiered.spread(t * 100 + i % 90, t * 100 + i % 90 + 10, i);
+		});
+	}
+	for (auto& writer : writers)
+		writer.join();
+
+	EXPECT_EQ(tiered.spill_error(), nullptr);
+	EXPECT_EQ(tiered.segment_count(), 4u);
+	for (int t = 0; t < 4; ++t) {
+		std::size_t values = 0;
+		tiered.find(t * 100 + 50, [&values](const buckets<int, int>::triplet_type& triplet) {
+			values = triplet.third.size();
+		});
+		EXPECT_EQ(values, 20u) << "segment " << t;
+	}
+
+	// a segment which cannot be written stays in memory; the edit stands
+	SegmentedBucket failing(100);
+	failing.spill_to(::testing::TempDir() + "/missing/directory", 1);
+	EXPECT_NO_THROW(failing.spread(0, 250, 1));
+	EXPECT_NE(failing.spill_error(), nullptr);
+	EXPECT_EQ(failing.resident_count(), 3u);
+	EXPECT_EQ(failing.size(), 3u);
+	EXPECT_THROW(failing.spill_to(::testing::TempDir() + "/missing/directory", 1), std::runtime_error);
+
+	// spilled segments are read back from where they were written, even
+	// after the directory changed
+	SegmentedBucket moved(100);
+	moved.spill_to(::testing::TempDir(), 1);
+	moved.spread(0, 10, 1);
+	moved.spread(100, 110, 2);
+	moved.spread(200, 210, 3);
+	EXPECT_EQ(moved.resident_count(), 1u);
+	moved.spill_to(::testing::TempDir() + "/missing/directory", 0);
+	int found = 0;
+	EXPECT_TRUE(moved.find(5, [&found](const buckets<int, int>::triplet_type& triplet) { found = triplet.third.front(); }));
+	EXPECT_EQ(found, 1);
+	EXPECT_TRUE(moved.drop(150));
+}
+
+TEST(RollupPyramidTest, MatchesFullScan) {
+	using TestBucket = buckets<int, int>;
+	using Rollup = rollup_pyramid<TestBucket, long long>;
+
+	auto scan = [](const TestBucket& bucket, int low, int high) {
+		long long total = 0;
+		for (auto p = bucket.begin(); p != bucket.end(); ++p) {
+			const int l = std::max(low, p->first);
+			const int h = std::min(high, p->second);
+			if (l < h)
+				total += std::accumulate(p->third.begin(), p->third.end(), 0LL) * (h - l);
+		}
+		return total;
+	};
+
+	unsigned seed = 9876;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket bucket;
+	bucket.spread(-30, 25, 3);
+
+	EXPECT_THROW(Rollup(bucket, 0, { 10, 25 }), std::invalid_argument);
+	EXPECT_EQ(bucket.observer(), nullptr);
+
+	Rollup rollup(bucket, -50, { 10, 50, 200 });
+	EXPECT_EQ(bucket.observer(), &rollup);
+	EXPECT_EQ(rollup.integral(-100, 100), 3 * 55);
+
+	for (int i = 0; i < 300; ++i) {
+		const bool batch = next(10) == 0;
+		if (batch)
+			bucket.begin_batch();
+
+		const int l = next(1000) - 100;
+		const int h = l + 1 + next(120);
+		if (next(4) == 0)
+			bucket.cover(l, h, next(20));
+		else
+			bucket.spread(l, h, next(20));
+
+		if (batch) {
+			if (next(2) == 0)
+				bucket.rollback();
+			else
+				bucket.commit();
+		}
+
+		const int low = next(1100) - 150;
+		const int high = low + next(600);
+		ASSERT_EQ(rollup.integral(low, high), scan(bucket, low, high)) << "after operation " << i;
+	}
+
+	for (std::size_t level = 0; level < rollup.levels(); ++level) {
+		const int width = rollup.width(level);
+		for (const auto& bin : rollup.level(level)) {
+			const int low = -50 + static_cast<int>(bin.first) * width;
+			ASSERT_EQ(bin.second, scan(bucket, low, low + width)) << "level " << level << " bin " << bin.first;
+		}
+	}
+
+	std::vector<std::pair<int, long long>> series;
+	rollup.series(0, 400, 100, series);
+	ASSERT_FALSE(series.empty());
+	for (const auto& bin : series) {
+		EXPECT_EQ((bin.first + 50) % 50, 0) << "served from the 50 wide level";
+		EXPECT_EQ(bin.second, scan(bucket, bin.first, bin.first + 50));
+	}
+}
+
+TEST(RollupPyramidTest, FollowsNonAccumulatingContainers) {
+	using UniqueBucket = buckets<int, int, compare_traits<int>, unique_bucket_value_traits<int>>;
+	using Rollup = rollup_pyramid<UniqueBucket, long long>;
+
+	UniqueBucket bucket;
+	Rollup rollup(bucket, 0, { 10, 100 });
+	EXPECT_THROW(Rollup(bucket, 0, { 10 }), std::logic_error);
+	EXPECT_EQ(bucket.observer(), &rollup);
+
+	// the second spread of 3 adds nothing to a set which holds it already
+	bucket.spread(0, 10, 3);
+	bucket.spread(0, 10, 3);
+	EXPECT_EQ(rollup.integral(0, 10), 30);
+	EXPECT_EQ(rollup.integral(0, 100), 30);
+
+	bucket.spread(5, 20, 4);
+	bucket.spread(0, 20, 4);
+	EXPECT_EQ(rollup.integral(0, 100), 10 * 7 + 10 * 4);
+	EXPECT_EQ(rollup.level(0).at(0), 10 * 7);
+	EXPECT_EQ(rollup.level(0).at(1), 10 * 4);
+
+	// running sums grow by the amount spread, so they are added in place
+	using AddBucket = buckets<int, int, compare_traits<int>, bucket_value_add_traits<int>>;
+	AddBucket sums;
+	rollup_pyramid<AddBucket, long long> sum_rollup(sums, 0, { 10, 100 });
+	sums.spread(0, 10, 3);
+	sums.spread(0, 10, 3);
+	sums.spread(5, 30, 2);
+	sums.cover(25, 40, 1);
+	EXPECT_EQ(sum_rollup.integral(0, 100), 5 * 6 + 5 * 8 + 15 * 2 + 15 * 1);
+	EXPECT_EQ(sum_rollup.integral(7, 26), 3 * 8 + 15 * 2 + 1 * 1);
+}
+
+TEST(BucketAlgoTest, ResampleMatchesRangeQueries) {
+	using SumBucket = buckets<int, int>;
+	using SetTraits = unique_bucket_value_traits<int>;
+	using SetBucket = buckets<int, int, compare_traits<int>, SetTraits>;
+
+	unsigned seed = 31337;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	SumBucket sums;
+	SetBucket sets;
+	numeric_buckets<int, double> numbers;
+	for (int i = 0; i < 150; ++i) {
+		const int l = next(1200) - 100;
+		const int h = l + 1 + next(90);
+		const int v = next(9);
+		sums.spread(l, h, v);
+		sets.spread(l, h, v);
+		numbers.spread(l, h, v);
+	}
+
+	const int origin = 15, step = 15;
+	const std::size_t bins = 60;
+
+	std::vector<long long> weighted;
+	EXPECT_GT(resample(sums, origin, step, bins, weighted, length_weighted_reducer<long long>()), 0);
+	ASSERT_EQ(weighted.size(), bins);
+
+	std::vector<double> numeric;
+	resample(numbers, origin, step, bins, numeric, length_weighted_reducer<double>());
+
+	std::vector<SetTraits::value_container> seen;
+	resample(sets, origin, step, bins, seen, container_union_reducer<SetTraits>());
+
+	for (std::size_t k = 0; k < bins; ++k) {
+		const int low = origin + static_cast<int>(k) * step;
+		const int high = low + step;
+
+		long long expected = 0;
+		for (auto p = sums.begin(); p != sums.end(); ++p) {
+			const int l = std::max(low, p->first), h = std::min(high, p->second);
+			if (l < h)
+				expected += std::accumulate(p->third.begin(), p->third.end(), 0LL) * (h - l);
+		}
+		EXPECT_EQ(weighted[k], expected) << "bin " << k;
+		EXPECT_EQ(numeric[k], static_cast<double>(expected)) << "bin " << k;
+
+		SetTraits::value_container values;
+		for (auto p = sets.begin(); p != sets.end(); ++p)
+			if (std::max(low, p->first) < std::min(high, p->second))
+				values.insert(p->third.begin(), p->third.end());
+		EXPECT_EQ(seen[k], values) << "bin " << k;
+	}
+
+	EXPECT_THROW(resample(sums, 0, 0, bins, weighted, length_weighted_reducer<long long>()), std::invalid_argument);
+	EXPECT_EQ(resample(sums, 5000, 10, bins, weighted, length_weighted_reducer<long long>()), 0);
+	EXPECT_EQ(weighted, std::vector<long long>(bins, 0));
+}
+
+TEST(RecurringBucketTest, MatchesEagerExpansion) {
+	using PlainBucket = buckets<int, std::string>;
+	using LazyBucket = recurring_buckets<int, std::string>;
+	using Triplets = std::vector<std::tuple<int, int, std::vector<std::string>>>;
+
+	// the buckets of [low, high), clipped to it
+	auto clip = [](const PlainBucket& bucket, int low, int high) {
+		Triplets result;
+		for (auto p = bucket.begin(); p != bucket.end(); ++p) {
+			const int l = std::max(low, p->first), h = std::min(high, p->second);
+			if (l < h)
+				result.emplace_back(l, h, std::vector<std::string>(p->third.begin(), p->third.end()));
+		}
+		return result;
+	};
+
+	{
+		// example6: open 9 to 17 every day of a year, lunch on one of them
+		LazyBucket lazy;
+		lazy.spread_recurring(9, 17, 24, 365, "Open");
+		EXPECT_EQ(lazy.rule_count(), 1u);
+		EXPECT_EQ(lazy.pending(), 365u);
+
+		lazy.spread(4 * 24 + 12, 4 * 24 + 13, "Lunch");
+		EXPECT_EQ(lazy.pending(), 364u) << "only the day of the lunch is materialized";
+
+		const PlainBucket& day = lazy.view(10 * 24, 11 * 24);
+		EXPECT_EQ(lazy.pending(), 363u);
+		EXPECT_EQ(day.size(), 4u);
+		EXPECT_EQ(lazy.view().size(), 367u);
+		EXPECT_EQ(lazy.rule_count(), 0u);
+	}
+
+	unsigned seed = 8080;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	for (int round = 0; round < 20; ++round) {
+		PlainBucket eager;
+		LazyBucket lazy;
+
+		for (int i = 0; i < 40; ++i) {
+			const std::string value = "v" + std::to_string(i);
+			const int l = next(1000);
+			const int h = l + 1 + next(60);
+			switch (next(6)) {
+			case 0:
+			case 1: {
+				const int period = 1 + next(120);
+				const std::size_t count = 1 + next(12);
+				const bool covering = next(3) == 0;
+				for (std::size_t k = 0; k < count; ++k) {
+					const int offset = static_cast<int>(k) * period;
+					if (covering)
+						eager.cover(l + offset, h + offset, value);
+					else
+						eager.spread(l + offset, h + offset, value);
+				}
+				if (covering)
+					lazy.cover_recurring(l, h, period, count, value);
+				else
+					lazy.spread_recurring(l, h, period, count, value);
+				break;
+			}
+			case 2:
+				EXPECT_EQ(eager.cover(l, h, value), lazy.cover(l, h, value));
+				break;
+			case 3:
+				EXPECT_EQ(eager.spread(l, h, value), lazy.spread(l, h, value));
+				break;
+			default: {
+				const int low = next(1200), high = low + next(300);
+				ASSERT_EQ(clip(lazy.view(low, high), low, high), clip(eager, low, high))
+					<< "round " << round << " operation " << i;
+				break;
+			}
+			}
+		}
+
+		ASSERT_EQ(clip(lazy.view(), -1, 5000), clip(eager, -1, 5000)) << "round " << round;
+		EXPECT_EQ(lazy.pending(), 0u);
+	}
+
+	LazyBucket lazy;
+	EXPECT_THROW(lazy.spread_recurring(0, 1, 0, 3, "x"), std::invalid_argument);
+}
+
+TEST(SweepCursorTest, ReportsChangesOfActiveValues) {
+	using TestBucket = buckets<int, int>;
+
+	unsigned seed = 2718;
+	auto next = [&seed](int range) {
+		seed = seed * 1103515245u + 12345u;
+		return static_cast<int>((seed >> 8) % static_cast<unsigned>(range));
+	};
+
+	TestBucket bucket;
+	for (int i = 0; i < 120; ++i) {
+		const int l = next(1000);
+		bucket.spread(l, l + 1 + next(40), next(8));
+	}
+
+	sweep_cursor<TestBucket> cursor(bucket);
+	int at = 0;
+	EXPECT_TRUE(cursor.next_change(at));
+	EXPECT_EQ(at, bucket.begin()->first);
+
+	std::multiset<int> active;
+	int changes = 0;
+	for (int time = -10; time < 1100; time += next(12)) {
+		const bool moved = cursor.advance(time,
+			[&](int v) { active.insert(v); },
+			[&](int v) { ASSERT_TRUE(active.count(v) > 0); active.erase(active.find(v)); });
+		changes += moved ? 1 : 0;
+
+		auto holding = std::find_if(bucket.begin(), bucket.end(),
+			[time](const TestBucket::triplet_type& t) { return t.first <= time && time < t.second; });
+		ASSERT_TRUE(holding == cursor.current()) << "time " << time;
+
+		std::vector<int> expected;
+		if (holding != bucket.end())
+			expected.assign(holding->third.begin(), holding->third.end());
+		std::sort(expected.begin(), expected.end());
+		ASSERT_EQ(cursor.active(), expected) << "time " << time;
+		ASSERT_EQ(std::vector<int>(active.begin(), active.end()), expected) << "time " << time;
+
+		if (cursor.next_change(at)) {
+			EXPECT_LT(time, at);
+		}
+		else {
+			EXPECT_TRUE(holding == bucket.end());
+		}
+	}
+	EXPECT_GT(changes, 10);
+	EXPECT_FALSE(cursor.advance(2000, [](int) {}, [](int) {}));
+	EXPECT_THROW(cursor.advance(0, [](int) {}, [](int) {}), std::logic_error);
+
+	// the buckets passed over between two calls are reported one by one,
+	// including the gap between them
+	TestBucket steps;
+	steps.spread(0, 10, 1);
+	steps.spread(10, 20, 1);
+	steps.spread(10, 20, 2);
+	steps.spread(30, 40, 3);
+	sweep_cursor<TestBucket> walker(steps);
+	std::string events;
+	auto entered = [&events](int v) { events += "e" + std::to_string(v) + " "; };
+	auto left = [&events](int v) { events += "l" + std::to_string(v) + " "; };
+	EXPECT_FALSE(walker.advance(-1, entered, left));
+	EXPECT_TRUE(walker.advance(35, entered, left));
+	EXPECT_EQ(events, "e1 e2 l1 l2 e3 ");
+	events.clear();
+	EXPECT_TRUE(walker.advance(45, entered, left)) << "into the gap after the last bucket";
+	EXPECT_EQ(events, "l3 ");
+}
+
+TEST(WorkloadTest, SeededWorkloadsAreReproducible) {
+	using Edits = std::vector<workload_edit<long long>>;
+
+	// FNV-1a over every field, so that the same seed is known to give the
+	// same workload everywhere
+	auto fingerprint = [](const Edits& edits) {
+		std::uint64_t hash = 14695981039346656037ull;
+		auto mix = [&hash](long long x) {
+			for (int i = 0; i < 8; ++i, x >>= 8) {
+				hash ^= static_cast<std::uint64_t>(x & 0xff);
+				hash *= 1099511628211ull;
+			}
+		};
+		for (const auto& edit : edits) {
+			mix(edit.kind == workload_kind::spread ? 0 : 1);
+			mix(edit.low);
+			mix(edit.high);
+			mix(edit.value);
+		}
+		return hash;
+	};
+
+	roster_options roster;
+	const Edits first = make_roster_workload<long long>(roster);
+	const Edits again = make_roster_workload<long long>(roster);
+	EXPECT_EQ(fingerprint(first), fingerprint(again));
+	EXPECT_EQ(fingerprint(first), 10217239310850363835ull) << "roster workload of seed 1";
+
+	roster.seed = 2;
+	EXPECT_NE(fingerprint(make_roster_workload<long long>(roster)), fingerprint(first));
+
+	int opens = 0, lunches = 0, long_shifts = 0;
+	for (const auto& edit : first) {
+		EXPECT_LT(edit.low, edit.high);
+		opens += edit.value == workload_open ? 1 : 0;
+		lunches += edit.kind == workload_kind::cover ? 1 : 0;
+		long_shifts += edit.value >= workload_first_id && edit.high - edit.low > 8 * workload_hour ? 1 : 0;
+	}
+	EXPECT_EQ(opens, roster.days);
+	EXPECT_GT(lunches, 0);
+	EXPECT_GT(long_shifts, 0) << "shift lengths have a long tail";
+
+	calendar_options calendar;
+	const Edits meetings = make_calendar_workload<long long>(calendar);
+	EXPECT_EQ(fingerprint(meetings), fingerprint(make_calendar_workload<long long>(calendar)));
+	EXPECT_EQ(fingerprint(meetings), 655243601814478664ull) << "calendar workload of seed 1";
+	EXPECT_GE(meetings.size(), static_cast<std::size_t>(calendar.weeks * 5 * calendar.meetings_per_day));
+
+	buckets<long long, int> bucket;
+	apply_workload(bucket, first);
+	EXPECT_GT(bucket.size(), 0u);
+	EXPECT_TRUE(std::any_of(bucket.begin(), bucket.end(), [](const buckets<long long, int>::triplet_type& t) {
+		return t.third.size() == 1 && t.third.front() == workload_lunch;
+	})) << "lunch covers replace everything under them";
+}
@@ -0,0 +1,52 @@
+// Runs the boundary search checks of test1.cpp once more, in a translation
+// unit which is compiled with AVX2 enabled (/arch:AVX2, or -mavx2), so that
+// the intrinsics of boundary_search.h are tested as well. It does not use the
+// precompiled header, which is compiled without AVX2.
+
+#include <algorithm>
+#include <ctime>
+#include <functional>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif // _MSC_VER
+
+#include "gtest/gtest.h"
+
+#include "../include/boundary_search.h"
+#include "../include/test/search_check.h"
+
+using namespace masutils;
+using namespace mastest;
+
+namespace {
+
+// the tests are built for AVX2, but may run where it is not available
+bool cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+	int info[4];
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#else
+	return __builtin_cpu_supports("avx2") != 0;
+#endif // _MSC_VER
+}
+
+} // namespace
+
+TEST(BoundarySearchAvx2Test, MatchesStdOnRandomData) {
+#if defined(__AVX2__)
+	if (!cpu_has_avx2())
+		return;
+
+	EXPECT_EQ((check_boundary_search<compare_traits<int>>(1, 300, -1000, 1, std::less<int>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits_descending<int>>(2, 300, -1000, 3, std::greater<int>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits<long long>>(3, 300, -1000LL, 1LL << 33, std::less<long long>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits_descending<time_t>>(4, 300, time_t(1700000000), time_t(60), std::greater<time_t>())), "");
+	EXPECT_EQ((check_boundary_search<compare_traits<unsigned>>(5, 300, 1u, 5u, std::less<unsigned>())), "");
+#else
+	FAIL() << "test_avx2.cpp has to be compiled with AVX2 enabled";
+#endif // __AVX2__
+}